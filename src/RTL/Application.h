@@ -4,13 +4,18 @@
 
 #include "RTL/Window/Window.h"
 #include "RTL/Renderer/Renderer.h"
+#include "RTL/Renderer/Culling.h"
 
 #include <chrono>
 #include <string>
 #include <fstream>
 #include <thread>
+#include <future>
+#include <functional>
 #include <direct.h>
 
+#define RTL_MAX_FRAME_LATENCY 3
+
 namespace RTL {
 
 	struct Camera {
@@ -42,17 +47,74 @@ namespace RTL {
 
 		void Run();
 
+		void SetMaxFrameLatency(const int frames);
+		int GetMaxFrameLatency() const { return m_MaxFrameLatency; }
+
+		void SetColorFormat(const ColorFormat colorFormat);
+		ColorFormat GetColorFormat() const { return m_ColorFormat; }
+
+		void SetFramebufferLayout(const FramebufferLayout layout);
+		FramebufferLayout GetFramebufferLayout() const { return m_FramebufferLayout; }
+
+		void SetDepthFormat(const DepthFormat depthFormat);
+		DepthFormat GetDepthFormat() const { return m_DepthFormat; }
+
+		// Lays down depth first so the shading pass runs the fragment shader once per visible pixel.
+		void SetZPrepass(const bool enable) { m_EnableZPrepass = enable; }
+		bool GetZPrepass() const { return m_EnableZPrepass; }
+
+		// Rasterizes gbuffer_t surfaces first and lights each covered pixel once afterwards.
+		template<typename gbuffer_t>
+		void SetDeferredShading(const Renderer::gbuffer_shader_t<varyings_t, uniforms_t, gbuffer_t> gbufferShader,
+								const Renderer::lighting_shader_t<gbuffer_t, uniforms_t> lightingShader);
+		void DisableDeferredShading();
+		bool GetDeferredShading() const { return m_GBufferSize > 0; }
+
+		// Rasterizes only depth and triangle ids, then runs the fragment shader once per pixel; overrides deferred shading.
+		// The fragment shader must not discard, alpha-tested materials need the forward or deferred path.
+		void SetVisibilityBuffer(const bool enable);
+		bool GetVisibilityBuffer() const { return m_EnableVisibilityBuffer; }
+
+		// Skips clusters of triangles whose bounds are outside the camera frustum before any vertex is shaded.
+		void SetFrustumCulling(const bool enable) { m_EnableFrustumCulling = enable; }
+		bool GetFrustumCulling() const { return m_EnableFrustumCulling; }
+
+		// Skips clusters whose normal cone shows every triangle facing away, unless the program is double sided.
+		void SetConeCulling(const bool enable) { m_EnableConeCulling = enable; }
+		bool GetConeCulling() const { return m_EnableConeCulling; }
+
+		// Rasterizes occluders into a small depth buffer and skips clusters hidden behind them. The occluders are
+		// the largest triangles of the mesh, picked at load, unless a simplified triangle list is designated.
+		void SetOcclusionCulling(const bool enable) { m_EnableOcclusionCulling = enable; }
+		bool GetOcclusionCulling() const { return m_EnableOcclusionCulling; }
+		// Model-space positions, three per triangle, wound like the mesh; only their front faces occlude unless the
+		// program is double sided. They must stay inside the surface they stand for. An empty list falls back to the
+		// mesh's own occluders.
+		void SetOccluders(const std::vector<Vec3>& triangles) { m_Occluders = triangles; }
+
+		// Counters of the last CullMesh call.
+		const CullingStats& GetCullingStats() const { return m_CullingStats; }
+
 	private:
 		void Init();
 		void Terminate();
 
+		void CreateFramebuffers();
+		void DestroyFramebuffers();
+		void WaitPresent();
+		void PresentFrame(Framebuffer* framebuffer, float time);
+
 		void OnCameraUpdate(float time);
 		void OnUpdate(float time);
 
 		void RotateCamera(Camera& camera, Vec3 Ang);
 
 		void LoadMesh(const char* fileName);
-		void DrawTrianglesThreaded();
+		void CullMesh(const Mat4& mvp);
+		template<typename func_t>
+		void DrawTrianglesThreaded(const func_t& drawTriangle);
+		void DrawShadedTriangles(const Program<vertex_t, varyings_t, uniforms_t>& program);
+		void DrawVisibilityBuffer();
 
 	private:
 		std::string m_Name;
@@ -61,10 +123,49 @@ namespace RTL {
 
 		Window* m_Window;
 		Framebuffer* m_Framebuffer;
+		Vec3 m_ClearColor = Vec3(0.09f, 0.10f, 0.14f);
+		ColorFormat m_ColorFormat = ColorFormat::RGB32F;
+		FramebufferLayout m_FramebufferLayout = FramebufferLayout::LINEAR;
+		DepthFormat m_DepthFormat = DepthFormat::FLOAT32;
+		bool m_EnableZPrepass = false;
+
+		int m_GBufferSize = 0;
+		int m_GBufferTarget = -1;
+		std::function<void(Framebuffer*, const Program<vertex_t, varyings_t, uniforms_t>&, const Triangle<vertex_t>&, const uniforms_t&)> m_DrawGBuffer;
+		std::function<void(Framebuffer*, const uniforms_t&)> m_ShadeGBuffer;
+
+		// Only what the visibility pass needs, the resolve shades the vertices of visible triangles again.
+		struct VisibilityTriangle {
+			Vec4 ClipPos[3];
+			int RowBegin, RowEnd;
+		};
+		bool m_EnableVisibilityBuffer = false;
+		int m_VisibilityTarget = -1;
+		std::vector<VisibilityTriangle> m_VisibilityTriangles;
+
+		int m_MaxFrameLatency = 2;
+		std::vector<Framebuffer*> m_Framebuffers;
+		std::shared_ptr<Font> m_Font;
+		std::vector<std::shared_future<void>> m_PresentTasks;
+		std::shared_future<void> m_LastPresent;
 
 		Camera m_Camera;
 		std::vector<Triangle<vertex_t>> m_Mesh;
 
+		// Meshlets built at load after sorting m_Mesh spatially, m_DrawList holds the triangles that survive culling this frame.
+		std::vector<MeshCluster> m_Clusters;
+		MeshCluster m_MeshBounds;
+		std::vector<uint32_t> m_DrawList;
+		bool m_EnableFrustumCulling = true;
+		bool m_EnableConeCulling = true;
+
+		bool m_EnableOcclusionCulling = false;
+		OcclusionBuffer m_OcclusionBuffer;
+		std::vector<Vec3> m_Occluders;
+		std::vector<Vec3> m_MeshOccluders;
+		std::vector<const MeshCluster*> m_VisibleClusters;
+		CullingStats m_CullingStats;
+
 		uniforms_t m_Uniforms;
 		Program<vertex_t, varyings_t, uniforms_t> m_Program;
 
@@ -104,8 +205,7 @@ namespace RTL {
 		Window::Init();
 		m_Window = Window::Create(m_Name, m_Width, m_Height);
 
-		m_Framebuffer = Framebuffer::Create(m_Width, m_Height);
-		m_Framebuffer->LoadFontTTF("simhei");
+		CreateFramebuffers();
 
 		m_Camera.Aspect = (float)m_Width / (float)m_Height;
 
@@ -116,15 +216,118 @@ namespace RTL {
 
 	template<typename vertex_t, typename varyings_t, typename uniforms_t>
 	void Application<vertex_t, varyings_t, uniforms_t>::Terminate() {
+		DestroyFramebuffers();
 		delete m_Window;
 		Window::Terminate();
 	}
 
+	template<typename vertex_t, typename varyings_t, typename uniforms_t>
+	void Application<vertex_t, varyings_t, uniforms_t>::CreateFramebuffers() {
+		DestroyFramebuffers();
+		if (!m_Font)
+			m_Font = Font::LoadFont("simhei");
+		for (int i = 0; i < m_MaxFrameLatency; i++) {
+			Framebuffer* framebuffer = Framebuffer::Create(m_Width, m_Height, m_ColorFormat, m_FramebufferLayout, m_DepthFormat);
+			framebuffer->SetFont(m_Font);
+			framebuffer->Clear(m_ClearColor);
+			framebuffer->ClearDepth(GetFarDepth(m_DepthFormat, m_Camera.Far));
+			if (m_GBufferSize > 0)
+				m_GBufferTarget = framebuffer->AddRenderTarget(m_GBufferSize);
+			if (m_EnableVisibilityBuffer)
+				m_VisibilityTarget = framebuffer->AddRenderTarget((int)sizeof(uint32_t));
+			m_Framebuffers.push_back(framebuffer);
+		}
+		m_PresentTasks.resize(m_Framebuffers.size());
+		m_Framebuffer = m_Framebuffers[0];
+	}
+
+	template<typename vertex_t, typename varyings_t, typename uniforms_t>
+	void Application<vertex_t, varyings_t, uniforms_t>::DestroyFramebuffers() {
+		WaitPresent();
+		for (Framebuffer* framebuffer : m_Framebuffers)
+			delete framebuffer;
+		m_Framebuffers.clear();
+		m_PresentTasks.clear();
+		m_Framebuffer = nullptr;
+	}
+
+	template<typename vertex_t, typename varyings_t, typename uniforms_t>
+	void Application<vertex_t, varyings_t, uniforms_t>::WaitPresent() {
+		for (auto& task : m_PresentTasks) {
+			if (task.valid())
+				task.wait();
+		}
+		m_LastPresent = std::shared_future<void>();
+	}
+
+	template<typename vertex_t, typename varyings_t, typename uniforms_t>
+	void Application<vertex_t, varyings_t, uniforms_t>::SetMaxFrameLatency(const int frames) {
+		m_MaxFrameLatency = std::min<int>(std::max<int>(frames, 1), RTL_MAX_FRAME_LATENCY);
+		CreateFramebuffers();
+	}
+
+	template<typename vertex_t, typename varyings_t, typename uniforms_t>
+	void Application<vertex_t, varyings_t, uniforms_t>::SetColorFormat(const ColorFormat colorFormat) {
+		m_ColorFormat = colorFormat;
+		CreateFramebuffers();
+	}
+
+	template<typename vertex_t, typename varyings_t, typename uniforms_t>
+	void Application<vertex_t, varyings_t, uniforms_t>::SetFramebufferLayout(const FramebufferLayout layout) {
+		m_FramebufferLayout = layout;
+		CreateFramebuffers();
+	}
+
+	template<typename vertex_t, typename varyings_t, typename uniforms_t>
+	void Application<vertex_t, varyings_t, uniforms_t>::SetDepthFormat(const DepthFormat depthFormat) {
+		m_DepthFormat = depthFormat;
+		CreateFramebuffers();
+	}
+
+	template<typename vertex_t, typename varyings_t, typename uniforms_t>
+	template<typename gbuffer_t>
+	void Application<vertex_t, varyings_t, uniforms_t>::SetDeferredShading(
+		const Renderer::gbuffer_shader_t<varyings_t, uniforms_t, gbuffer_t> gbufferShader,
+		const Renderer::lighting_shader_t<gbuffer_t, uniforms_t> lightingShader) {
+
+		m_GBufferSize = (int)sizeof(gbuffer_t);
+		CreateFramebuffers();
+
+		const int target = m_GBufferTarget;
+		m_DrawGBuffer = [gbufferShader, target](Framebuffer* framebuffer, const Program<vertex_t, varyings_t, uniforms_t>& program,
+												const Triangle<vertex_t>& triangle, const uniforms_t& uniforms) {
+			Renderer::DrawGBuffer(framebuffer, target, program, gbufferShader, triangle, uniforms);
+		};
+		m_ShadeGBuffer = [lightingShader, target](Framebuffer* framebuffer, const uniforms_t& uniforms) {
+			Renderer::ShadeGBuffer(framebuffer, target, lightingShader, uniforms);
+		};
+	}
+
+	template<typename vertex_t, typename varyings_t, typename uniforms_t>
+	void Application<vertex_t, varyings_t, uniforms_t>::DisableDeferredShading() {
+		m_GBufferSize = 0;
+		m_GBufferTarget = -1;
+		m_DrawGBuffer = nullptr;
+		m_ShadeGBuffer = nullptr;
+		CreateFramebuffers();
+	}
+
+	template<typename vertex_t, typename varyings_t, typename uniforms_t>
+	void Application<vertex_t, varyings_t, uniforms_t>::SetVisibilityBuffer(const bool enable) {
+		m_EnableVisibilityBuffer = enable;
+		m_VisibilityTarget = -1;
+		CreateFramebuffers();
+	}
+
 	template<typename vertex_t, typename varyings_t, typename uniforms_t>
 	void Application<vertex_t, varyings_t, uniforms_t>::Run() {
+		size_t frameIndex = 0;
 		while (!m_Window->Closed()) {
-			m_Framebuffer->Clear(Vec3(0.09f, 0.10f, 0.14f));
-			m_Framebuffer->ClearDepth(m_Camera.Far);
+			const size_t slot = frameIndex % m_Framebuffers.size();
+			if (m_PresentTasks[slot].valid())
+				m_PresentTasks[slot].wait();
+			m_Framebuffer = m_Framebuffers[slot];
+
 			m_Window->PollInputEvents();
 
 			float deltaTime = (std::chrono::steady_clock::now() - m_LastFrameTime).count() * 0.001f * 0.001f;
@@ -132,8 +335,32 @@ namespace RTL {
 			m_LastFrameTime = std::chrono::steady_clock::now();
 
 			OnUpdate(deltaTime);
-			m_Window->DrawFramebuffer(m_Framebuffer);
+
+			// The overlay, present and clear of this frame overlap the geometry work of the next ones,
+			// presents stay in submission order by chaining on the previous task.
+			Framebuffer* framebuffer = m_Framebuffer;
+			std::shared_future<void> previous = m_LastPresent;
+			const float clearDepth = GetFarDepth(m_DepthFormat, m_Camera.Far);
+			m_LastPresent = std::async(std::launch::async, [this, framebuffer, previous, deltaTime, clearDepth]() {
+				if (previous.valid())
+					previous.wait();
+				PresentFrame(framebuffer, deltaTime);
+				framebuffer->Clear(m_ClearColor);
+				framebuffer->ClearDepth(clearDepth);
+			}).share();
+			m_PresentTasks[slot] = m_LastPresent;
+
+			frameIndex++;
 		}
+		WaitPresent();
+	}
+
+	template<typename vertex_t, typename varyings_t, typename uniforms_t>
+	void Application<vertex_t, varyings_t, uniforms_t>::PresentFrame(Framebuffer* framebuffer, float time) {
+		float FPS = 1.0f / time * 1000.0f;
+		framebuffer->DrawTextTTF(0, 0, std::to_string(FPS), Vec3(1.0f, 1.0f, 1.0f), 20.0f);
+
+		m_Window->DrawFramebuffer(framebuffer);
 	}
 
 	template<typename vertex_t, typename varyings_t, typename uniforms_t>
@@ -196,11 +423,12 @@ namespace RTL {
 	}
 
 	template<typename vertex_t, typename varyings_t, typename uniforms_t>
-	void Application<vertex_t, varyings_t, uniforms_t>::DrawTrianglesThreaded() {
+	template<typename func_t>
+	void Application<vertex_t, varyings_t, uniforms_t>::DrawTrianglesThreaded(const func_t& drawTriangle) {
 		size_t threadCount = std::thread::hardware_concurrency();
 		threadCount = std::max<size_t>(threadCount, (size_t)1);
 
-		const size_t triangleCount = m_Mesh.size();
+		const size_t triangleCount = m_DrawList.size();
 		if (triangleCount == 0) return;
 
 		const size_t trianglePerThread = triangleCount / threadCount;
@@ -219,7 +447,7 @@ namespace RTL {
 
 			threads.emplace_back([&, threadTriangleStart, threadTriangleEnd]() {
 				for (size_t j = threadTriangleStart; j < threadTriangleEnd; j++) {
-					Renderer::Draw(m_Framebuffer, m_Program, m_Mesh[j], m_Uniforms);
+					drawTriangle(m_DrawList[j]);
 				}
 			});
 		}
@@ -241,14 +469,152 @@ namespace RTL {
 		m_Uniforms.MVP = proj * view * model;
 		m_Uniforms.CameraPos = m_Camera.Pos;
 		m_Uniforms.Model = model;
+		m_Uniforms.ViewProj = proj * view;
+		m_Uniforms.ViewportWidth = m_Width;
+		m_Uniforms.ViewportHeight = m_Height;
 		
 		m_ShaderUpdate(m_Uniforms);
 
-		DrawTrianglesThreaded();
+		CullMesh(m_Uniforms.MVP);
 
-		float FPS = 1.0f / time * 1000.0f;
-        m_Framebuffer->DrawTextTTF(0, 0, std::to_string(FPS), Vec3(1.0f, 1.0f, 1.0f), 20.0f);
+		if (m_EnableVisibilityBuffer) {
+			DrawVisibilityBuffer();
+			return;
+		}
+
+		if (!m_EnableZPrepass) {
+			DrawShadedTriangles(m_Program);
+		}
+		else {
+			Program<vertex_t, varyings_t, uniforms_t> depthProgram = m_Program;
+			depthProgram.EnableWriteDepth = true;
+			depthProgram.EnableBlockDepthCull = true;
+			DrawTrianglesThreaded([&](const size_t index) {
+				Renderer::DrawDepth(m_Framebuffer, depthProgram, m_Mesh[index], m_Uniforms);
+			});
+
+			Program<vertex_t, varyings_t, uniforms_t> shadeProgram = m_Program;
+			shadeProgram.DepthFunc = DepthFuncType::LEQUAL;
+			shadeProgram.EnableWriteDepth = false;
+			shadeProgram.EnableBlockDepthCull = true;
+			DrawShadedTriangles(shadeProgram);
+		}
+
+		if (m_ShadeGBuffer)
+			m_ShadeGBuffer(m_Framebuffer, m_Uniforms);
+	}
+
+	template<typename vertex_t, typename varyings_t, typename uniforms_t>
+	void Application<vertex_t, varyings_t, uniforms_t>::CullMesh(const Mat4& mvp) {
+		m_DrawList.clear();
+		m_VisibleClusters.clear();
+		m_CullingStats = CullingStats();
+		m_CullingStats.ClusterCount = (uint32_t)m_Clusters.size();
+
+		// Bounds and cones are in model space, the eye and frustum taken from the MVP test them without transforming.
+		const Frustum frustum(mvp);
+		if (m_EnableFrustumCulling && (!frustum.IsVisible(m_MeshBounds.Sphere) || !frustum.IsVisible(m_MeshBounds.Box))) {
+			m_CullingStats.FrustumCulled = m_CullingStats.ClusterCount;
+			return;
+		}
+		Vec3 eye;
+		const bool coneCulling = m_EnableConeCulling && !m_Program.EnableDoubleSided && GetEyePosition(mvp, eye);
+
+		for (const MeshCluster& cluster : m_Clusters) {
+			if (m_EnableFrustumCulling && (!frustum.IsVisible(cluster.Sphere) || !frustum.IsVisible(cluster.Box))) {
+				m_CullingStats.FrustumCulled++;
+				continue;
+			}
+			if (coneCulling && IsClusterBackFacing(cluster, eye)) {
+				m_CullingStats.BackfaceCulled++;
+				continue;
+			}
+			m_VisibleClusters.push_back(&cluster);
+		}
+
+		// Occluders rasterize only the faces the program draws, and a triangle never occludes the box of its own
+		// cluster, so the mesh can be its own occluder even when it is not closed.
+		if (m_EnableOcclusionCulling) {
+			const std::vector<Vec3>& occluders = m_Occluders.empty() ? m_MeshOccluders : m_Occluders;
+			m_OcclusionBuffer.Clear();
+			for (size_t i = 0; i + 2 < occluders.size(); i += 3) {
+				m_OcclusionBuffer.RasterizeTriangle(
+					mvp * Vec4(occluders[i], 1.0f), mvp * Vec4(occluders[i + 1], 1.0f), mvp * Vec4(occluders[i + 2], 1.0f),
+					m_Program.EnableDoubleSided);
+			}
+			m_CullingStats.OccluderTriangles = (uint32_t)(occluders.size() / 3);
+		}
 
+		for (const MeshCluster* cluster : m_VisibleClusters) {
+			if (m_EnableOcclusionCulling && !m_OcclusionBuffer.IsVisible(mvp, cluster->Box)) {
+				m_CullingStats.OcclusionCulled++;
+				continue;
+			}
+			for (uint32_t i = cluster->Begin; i < cluster->End; i++)
+				m_DrawList.push_back(i);
+		}
+		m_CullingStats.DrawnTriangles = (uint32_t)m_DrawList.size();
+	}
+
+	template<typename vertex_t, typename varyings_t, typename uniforms_t>
+	void Application<vertex_t, varyings_t, uniforms_t>::DrawShadedTriangles(const Program<vertex_t, varyings_t, uniforms_t>& program) {
+		if (m_DrawGBuffer) {
+			DrawTrianglesThreaded([&](const size_t index) {
+				m_DrawGBuffer(m_Framebuffer, program, m_Mesh[index], m_Uniforms);
+			});
+		}
+		else {
+			DrawTrianglesThreaded([&](const size_t index) {
+				Renderer::Draw(m_Framebuffer, program, m_Mesh[index], m_Uniforms);
+			});
+		}
+	}
+
+	template<typename vertex_t, typename varyings_t, typename uniforms_t>
+	void Application<vertex_t, varyings_t, uniforms_t>::DrawVisibilityBuffer() {
+		Program<vertex_t, varyings_t, uniforms_t> visibilityProgram = m_Program;
+		visibilityProgram.EnableWriteDepth = true;
+		visibilityProgram.EnableBlockDepthCull = true;
+
+		const int height = m_Framebuffer->GetHeight();
+		const int triangleCount = (int)m_DrawList.size();
+		m_VisibilityTriangles.resize(triangleCount);
+		ParallelFor(0, triangleCount, [&](const int begin, const int end) {
+			for (int i = begin; i < end; i++) {
+				varyings_t shaded[3];
+				Renderer::ShadeVertices(shaded, visibilityProgram, m_Mesh[m_DrawList[i]], m_Uniforms);
+				VisibilityTriangle& triangle = m_VisibilityTriangles[i];
+				for (int j = 0; j < 3; j++)
+					triangle.ClipPos[j] = shaded[j].ClipPos;
+				Renderer::GetRowRange(triangle.ClipPos, height, triangle.RowBegin, triangle.RowEnd);
+			}
+		});
+
+		// Each worker owns interleaved bands of tile rows and draws every triangle touching them in submission
+		// order, so depth and id of a pixel always come from the same triangle.
+		const int bandRows = RTL_TILE_SIZE * 4;
+		const int bandCount = (height + bandRows - 1) / bandRows;
+		const int workerCount = (int)std::min<size_t>(GetWorkerCount(), (size_t)bandCount);
+		ParallelFor(0, workerCount, [&](const int begin, const int end) {
+			for (int worker = begin; worker < end; worker++) {
+				for (int band = worker; band < bandCount; band += workerCount) {
+					const int rowBegin = band * bandRows;
+					const int rowEnd = std::min<int>(rowBegin + bandRows, height);
+					for (int i = 0; i < triangleCount; i++) {
+						const VisibilityTriangle& triangle = m_VisibilityTriangles[i];
+						if (triangle.RowEnd <= rowBegin || triangle.RowBegin >= rowEnd)
+							continue;
+						Renderer::DrawVisibility(m_Framebuffer, m_VisibilityTarget, visibilityProgram, triangle.ClipPos,
+												 Renderer::PackVisibilityID(0, m_DrawList[i]), rowBegin, rowEnd);
+					}
+				}
+			}
+		});
+
+		Renderer::ResolveVisibility(m_Framebuffer, m_VisibilityTarget, m_Program, m_Uniforms,
+			[&](const uint32_t id, varyings_t(&shaded)[3]) {
+				Renderer::ShadeVertices(shaded, m_Program, m_Mesh[Renderer::GetVisibilityTriangle(id)], m_Uniforms);
+			});
 	}
 
 	template<typename vertex_t, typename varyings_t, typename uniforms_t>
@@ -334,6 +700,12 @@ namespace RTL {
 			m_Mesh.emplace_back(triangle);
 		}
 
+		SortMeshSpatially(m_Mesh);
+		m_Clusters = BuildMeshClusters(m_Mesh);
+		m_MeshBounds = MergeMeshClusters(m_Clusters);
+		m_MeshOccluders = SelectOccluders(m_Mesh);
+		m_DrawList.reserve(m_Mesh.size());
+
 	}
 
 }
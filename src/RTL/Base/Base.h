@@ -5,3 +5,7 @@
 #else
 #define ASSERT(x, ...)
 #endif
+
+#if defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define RTL_SSE2
+#endif
@@ -1,5 +1,7 @@
 #include "Maths.h"
 
+#include <cstring>
+
 namespace RTL {
 
     Mat4::Mat4(const Vec4& v0, const Vec4& v1, const Vec4& v2, const Vec4& v3) {
@@ -309,6 +311,122 @@ namespace RTL {
         return (float)c / 255.0f;
     }
 
+    // Round-to-nearest-even, overflow goes to infinity, NaN stays NaN.
+    uint16_t Float2Half(const float f) {
+        uint32_t bits;
+        memcpy(&bits, &f, sizeof(bits));
+        const uint32_t sign = (bits >> 16) & 0x8000u;
+        bits &= 0x7FFFFFFFu;
+
+        uint16_t half;
+        if (bits >= (143u << 23)) {
+            half = bits > 0x7F800000u ? 0x7E00 : 0x7C00;
+        }
+        else if (bits < (113u << 23)) {
+            const uint32_t denormMagicBits = 126u << 23;
+            float value, denormMagic;
+            memcpy(&value, &bits, sizeof(value));
+            memcpy(&denormMagic, &denormMagicBits, sizeof(denormMagic));
+            value += denormMagic;
+            memcpy(&bits, &value, sizeof(bits));
+            half = (uint16_t)(bits - denormMagicBits);
+        }
+        else {
+            const uint32_t mantissaOdd = (bits >> 13) & 1u;
+            bits += 0xC8000FFFu;
+            bits += mantissaOdd;
+            half = (uint16_t)(bits >> 13);
+        }
+        return (uint16_t)(half | sign);
+    }
+
+    float Half2Float(const uint16_t h) {
+        const uint32_t shiftedExp = 0x7C00u << 13;
+        uint32_t bits = ((uint32_t)h & 0x7FFFu) << 13;
+        const uint32_t exp = shiftedExp & bits;
+        bits += (127u - 15u) << 23;
+
+        float f;
+        if (exp == shiftedExp) {
+            bits += (128u - 16u) << 23;
+            memcpy(&f, &bits, sizeof(f));
+        }
+        else if (exp == 0) {
+            bits += 1u << 23;
+            memcpy(&f, &bits, sizeof(f));
+            f -= 6.10351562e-05f;
+        }
+        else {
+            memcpy(&f, &bits, sizeof(f));
+        }
+
+        bits = ((uint32_t)h & 0x8000u) << 16;
+        uint32_t out;
+        memcpy(&out, &f, sizeof(out));
+        out |= bits;
+        memcpy(&f, &out, sizeof(f));
+        return f;
+    }
+
+    // Unsigned small float with a 5-bit exponent, clamped to the largest finite value.
+    static uint32_t Float2UFloat(const float f, const int mantissaBits) {
+        if (!(f > 0.0f))
+            return 0u;
+        const uint32_t half = Float2Half(f);
+        const int shift = 10 - mantissaBits;
+        const uint32_t infinity = 0x1Fu << mantissaBits;
+        if (half >= 0x7C00u)
+            return half > 0x7C00u ? 0u : infinity - 1u;
+        const uint32_t rounded = (half + (1u << (shift - 1)) - 1u + ((half >> shift) & 1u)) >> shift;
+        return rounded < infinity ? rounded : infinity - 1u;
+    }
+
+    uint32_t PackR11G11B10F(const Vec3& color) {
+        return Float2UFloat(color.X, 6) | (Float2UFloat(color.Y, 6) << 11) | (Float2UFloat(color.Z, 5) << 22);
+    }
+
+    Vec3 UnpackR11G11B10F(const uint32_t packed) {
+        return Vec3(
+            Half2Float((uint16_t)((packed & 0x7FFu) << 4)),
+            Half2Float((uint16_t)(((packed >> 11) & 0x7FFu) << 4)),
+            Half2Float((uint16_t)(((packed >> 22) & 0x3FFu) << 5))
+        );
+    }
+
+    uint32_t PackRGB9E5(const Vec3& color) {
+        constexpr float maxValue = 65408.0f;
+        const float r = color.X > 0.0f ? std::min<float>(color.X, maxValue) : 0.0f;
+        const float g = color.Y > 0.0f ? std::min<float>(color.Y, maxValue) : 0.0f;
+        const float b = color.Z > 0.0f ? std::min<float>(color.Z, maxValue) : 0.0f;
+        const float maxChannel = std::max<float>(r, std::max<float>(g, b));
+        if (maxChannel < 1.0f / (1 << 24))
+            return 0u;
+
+        int exponent;
+        std::frexp(maxChannel, &exponent);
+        int shared = std::max<int>(exponent, -15) + 15;
+        float scale = std::ldexp(1.0f, 9 - (shared - 15));
+        if ((int)(maxChannel * scale + 0.5f) == 512) {
+            shared++;
+            scale *= 0.5f;
+        }
+
+        return (uint32_t)(r * scale + 0.5f) | ((uint32_t)(g * scale + 0.5f) << 9) |
+            ((uint32_t)(b * scale + 0.5f) << 18) | ((uint32_t)shared << 27);
+    }
+
+    Vec3 UnpackRGB9E5(const uint32_t packed) {
+        // 2^(exponent - 15 - 9) built directly in the float exponent field.
+        const uint32_t bits = ((packed >> 27) + 103u) << 23;
+        float scale;
+        memcpy(&scale, &bits, sizeof(scale));
+        return Vec3(
+            (float)(packed & 0x1FFu) * scale,
+            (float)((packed >> 9) & 0x1FFu) * scale,
+            (float)((packed >> 18) & 0x1FFu) * scale
+        );
+    }
+
     float Max(const float right, const float left) {
         return std::max<float>(right, left);
     }
@@ -3,6 +3,7 @@
 #include "RTL/Base/Base.h"
 
 #include <cmath>
+#include <cstdint>
 #include <string>
 #include <iostream>
 #include <algorithm>
@@ -131,6 +132,16 @@ namespace RTL {
     unsigned char Float2UChar(const float f);
     float UChar2Float(const unsigned char c);
 
+    uint16_t Float2Half(const float f);
+    float Half2Float(const uint16_t h);
+
+    uint32_t PackR11G11B10F(const Vec3& color);
+    Vec3 UnpackR11G11B10F(const uint32_t packed);
+
+    // 9-bit mantissas sharing a 5-bit exponent, negative values clamp to 0.
+    uint32_t PackRGB9E5(const Vec3& color);
+    Vec3 UnpackRGB9E5(const uint32_t packed);
+
     float Max(const float right, const float left);
     float Min(const float right, const float left);
 
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+namespace RTL {
+
+	inline size_t GetWorkerCount() {
+		size_t threadCount = std::thread::hardware_concurrency();
+		return std::max<size_t>(threadCount, (size_t)1);
+	}
+
+	// Splits [begin, end) into one contiguous range per worker and calls func(rangeBegin, rangeEnd) on each.
+	template<typename func_t>
+	void ParallelFor(const int begin, const int end, const func_t& func) {
+		const int count = end - begin;
+		if (count <= 0) return;
+
+		const int threadCount = (int)std::min<size_t>(GetWorkerCount(), (size_t)count);
+		if (threadCount == 1) {
+			func(begin, end);
+			return;
+		}
+
+		const int countPerThread = count / threadCount;
+		const int remaining = count % threadCount;
+
+		std::vector<std::thread> threads;
+		threads.reserve(threadCount - 1);
+
+		int current = begin;
+		int firstEnd = begin;
+		for (int i = 0; i < threadCount; i++) {
+			int rangeBegin = current;
+			int rangeEnd = current + countPerThread + (i < remaining ? 1 : 0);
+			current = rangeEnd;
+
+			if (i == 0) {
+				firstEnd = rangeEnd;
+				continue;
+			}
+			threads.emplace_back([&func, rangeBegin, rangeEnd]() {
+				func(rangeBegin, rangeEnd);
+			});
+		}
+
+		func(begin, firstEnd);
+
+		for (auto& thread : threads) {
+			if (thread.joinable())
+				thread.join();
+		}
+	}
+
+}
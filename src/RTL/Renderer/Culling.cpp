@@ -0,0 +1,268 @@
+#include "Culling.h"
+
+#include "RTL/Base/Base.h"
+
+namespace RTL {
+
+	void AABB::Expand(const Vec3& point) {
+		Min = Vec3(std::min<float>(Min.X, point.X), std::min<float>(Min.Y, point.Y), std::min<float>(Min.Z, point.Z));
+		Max = Vec3(std::max<float>(Max.X, point.X), std::max<float>(Max.Y, point.Y), std::max<float>(Max.Z, point.Z));
+	}
+
+	void AABB::Expand(const AABB& box) {
+		if (box.IsEmpty())
+			return;
+		Expand(box.Min);
+		Expand(box.Max);
+	}
+
+	// Rows 3 +- 0, 1, 2 of the matrix are the -W <= X, Y, Z <= W planes the clipper uses.
+	Frustum::Frustum(const Mat4& matrix) {
+		for (int i = 0; i < 6; i++) {
+			const int row = i / 2;
+			const float sign = (i % 2) ? -1.0f : 1.0f;
+			Vec4 plane(
+				matrix.M[3][0] + sign * matrix.M[row][0],
+				matrix.M[3][1] + sign * matrix.M[row][1],
+				matrix.M[3][2] + sign * matrix.M[row][2],
+				matrix.M[3][3] + sign * matrix.M[row][3]);
+			const float length = Length(Vec3(plane));
+			m_Planes[i] = length > 0.0f ? plane / length : plane;
+		}
+	}
+
+	bool Frustum::IsVisible(const AABB& box) const {
+		if (box.IsEmpty())
+			return false;
+		for (const Vec4& plane : m_Planes) {
+			// The corner farthest along the plane normal decides whether the whole box is outside.
+			const Vec3 corner(
+				plane.X >= 0.0f ? box.Max.X : box.Min.X,
+				plane.Y >= 0.0f ? box.Max.Y : box.Min.Y,
+				plane.Z >= 0.0f ? box.Max.Z : box.Min.Z);
+			if (Dot(Vec3(plane), corner) + plane.W < 0.0f)
+				return false;
+		}
+		return true;
+	}
+
+	bool Frustum::IsVisible(const BoundingSphere& sphere) const {
+		for (const Vec4& plane : m_Planes) {
+			if (Dot(Vec3(plane), sphere.Center) + plane.W < -sphere.Radius)
+				return false;
+		}
+		return true;
+	}
+
+	static uint32_t SpreadBits10(uint32_t value) {
+		value = (value | (value << 16)) & 0x030000FFu;
+		value = (value | (value << 8)) & 0x0300F00Fu;
+		value = (value | (value << 4)) & 0x030C30C3u;
+		value = (value | (value << 2)) & 0x09249249u;
+		return value;
+	}
+
+	uint32_t GetMortonCode(const Vec3& position, const AABB& bounds) {
+		const Vec3 size = bounds.Max - bounds.Min;
+		const float x = size.X > 0.0f ? (position.X - bounds.Min.X) / size.X : 0.0f;
+		const float y = size.Y > 0.0f ? (position.Y - bounds.Min.Y) / size.Y : 0.0f;
+		const float z = size.Z > 0.0f ? (position.Z - bounds.Min.Z) / size.Z : 0.0f;
+		const uint32_t ix = (uint32_t)(Clamp(x, 0.0f, 1.0f) * 1023.0f);
+		const uint32_t iy = (uint32_t)(Clamp(y, 0.0f, 1.0f) * 1023.0f);
+		const uint32_t iz = (uint32_t)(Clamp(z, 0.0f, 1.0f) * 1023.0f);
+		return SpreadBits10(ix) | (SpreadBits10(iy) << 1) | (SpreadBits10(iz) << 2);
+	}
+
+	uint32_t GetDominantAxis(const Vec3& normal) {
+		const float x = std::fabs(normal.X);
+		const float y = std::fabs(normal.Y);
+		const float z = std::fabs(normal.Z);
+		if (x >= y && x >= z)
+			return normal.X >= 0.0f ? 0 : 1;
+		if (y >= z)
+			return normal.Y >= 0.0f ? 2 : 3;
+		return normal.Z >= 0.0f ? 4 : 5;
+	}
+
+	MeshCluster MergeMeshClusters(const std::vector<MeshCluster>& clusters) {
+		MeshCluster merged;
+		if (clusters.empty())
+			return merged;
+
+		merged.Begin = clusters.front().Begin;
+		merged.End = clusters.back().End;
+		for (const MeshCluster& cluster : clusters)
+			merged.Box.Expand(cluster.Box);
+
+		merged.Sphere.Center = merged.Box.GetCenter();
+		for (const MeshCluster& cluster : clusters)
+			merged.Sphere.Radius = std::max<float>(merged.Sphere.Radius,
+				Length(cluster.Sphere.Center - merged.Sphere.Center) + cluster.Sphere.Radius);
+		return merged;
+	}
+
+	void ComputeNormalCone(MeshCluster& cluster, const std::vector<Vec3>& faceNormals) {
+		cluster.ConeAxis = Vec3(0.0f, 0.0f, 0.0f);
+		cluster.ConeCutoff = 1.0f;
+
+		Vec3 sum(0.0f, 0.0f, 0.0f);
+		for (const Vec3& normal : faceNormals) {
+			const float length = Length(normal);
+			if (length > 0.0f)
+				sum += normal / length;
+		}
+		const float sumLength = Length(sum);
+		if (sumLength <= 0.0f)
+			return;
+
+		// Degenerate triangles are skipped, they are never rasterized.
+		const Vec3 axis = sum / sumLength;
+		float minDot = 1.0f;
+		for (const Vec3& normal : faceNormals) {
+			const float length = Length(normal);
+			if (length > 0.0f)
+				minDot = std::min<float>(minDot, Dot(normal, axis) / length);
+		}
+
+		cluster.ConeAxis = axis;
+		if (minDot > 0.0f)
+			cluster.ConeCutoff = std::sqrt(1.0f - minDot * minDot);
+	}
+
+	// Intersection of the planes rows 0, 1 and 3 of the matrix describe.
+	bool GetEyePosition(const Mat4& matrix, Vec3& eye) {
+		const Vec3 n0(matrix.M[0][0], matrix.M[0][1], matrix.M[0][2]);
+		const Vec3 n1(matrix.M[1][0], matrix.M[1][1], matrix.M[1][2]);
+		const Vec3 n3(matrix.M[3][0], matrix.M[3][1], matrix.M[3][2]);
+		const Vec3 c13 = Cross(n1, n3);
+		const float det = Dot(n0, c13);
+		if (std::fabs(det) < EPSILON * Length(n0) * Length(c13))
+			return false;
+
+		eye = (c13 * matrix.M[0][3] + Cross(n3, n0) * matrix.M[1][3] + Cross(n0, n1) * matrix.M[3][3]) * (-1.0f / det);
+		return true;
+	}
+
+	// A triangle faces away when its normal n satisfies Dot(n, p - eye) >= 0. With every normal within the cone,
+	// that holds for the whole sphere once the view direction is within 90 degrees minus the cone angle of the axis.
+	bool IsClusterBackFacing(const MeshCluster& cluster, const Vec3& eye) {
+		if (cluster.ConeCutoff >= 1.0f)
+			return false;
+		const Vec3 view = cluster.Sphere.Center - eye;
+		return Dot(view, cluster.ConeAxis) >= cluster.ConeCutoff * Length(view) + cluster.Sphere.Radius;
+	}
+
+	OcclusionBuffer::OcclusionBuffer(const int width, const int height)
+		: m_Width(width), m_Height(height), m_Depth((size_t)width * height, 1.0f) {
+		ASSERT(width > 0 && height > 0);
+	}
+
+	void OcclusionBuffer::Clear() {
+		std::fill(m_Depth.begin(), m_Depth.end(), 1.0f);
+	}
+
+	void OcclusionBuffer::RasterizeTriangle(const Vec4& clip0, const Vec4& clip1, const Vec4& clip2, const bool doubleSided) {
+		if (clip0.W <= EPSILON || clip1.W <= EPSILON || clip2.W <= EPSILON)
+			return;
+
+		Vec3 v[3];
+		const Vec4* clip[3] = { &clip0, &clip1, &clip2 };
+		for (int i = 0; i < 3; i++) {
+			const float invW = 1.0f / clip[i]->W;
+			v[i] = Vec3((clip[i]->X * invW * 0.5f + 0.5f) * m_Width,
+						(clip[i]->Y * invW * 0.5f + 0.5f) * m_Height,
+						clip[i]->Z * invW * 0.5f + 0.5f);
+		}
+
+		// Edges are oriented so the inside is positive.
+		float area = (v[1].X - v[0].X) * (v[2].Y - v[0].Y) - (v[1].Y - v[0].Y) * (v[2].X - v[0].X);
+		if (std::fabs(area) < EPSILON || (area < 0.0f && !doubleSided))
+			return;
+		if (area < 0.0f) {
+			std::swap(v[1], v[2]);
+			area = -area;
+		}
+
+		const int minX = std::max<int>((int)std::floor(std::min<float>(v[0].X, std::min<float>(v[1].X, v[2].X))), 0);
+		const int maxX = std::min<int>((int)std::ceil(std::max<float>(v[0].X, std::max<float>(v[1].X, v[2].X))), m_Width);
+		const int minY = std::max<int>((int)std::floor(std::min<float>(v[0].Y, std::min<float>(v[1].Y, v[2].Y))), 0);
+		const int maxY = std::min<int>((int)std::ceil(std::max<float>(v[0].Y, std::max<float>(v[1].Y, v[2].Y))), m_Height);
+		if (minX >= maxX || minY >= maxY)
+			return;
+
+		// Edge i is A * x + B * y + C, positive inside. Its smallest value over the cell [x, x + 1) x [y, y + 1)
+		// is at the corner offset by (A < 0, B < 0), so testing that corner requires all four to be inside.
+		float edgeA[3], edgeB[3], edgeC[3];
+		for (int i = 0; i < 3; i++) {
+			const Vec3& p0 = v[(i + 1) % 3];
+			const Vec3& p1 = v[(i + 2) % 3];
+			edgeA[i] = p0.Y - p1.Y;
+			edgeB[i] = p1.X - p0.X;
+			edgeC[i] = p0.X * p1.Y - p0.Y * p1.X;
+			edgeC[i] += std::min<float>(edgeA[i], 0.0f) + std::min<float>(edgeB[i], 0.0f);
+		}
+
+		const float dzdx = (edgeA[0] * v[0].Z + edgeA[1] * v[1].Z + edgeA[2] * v[2].Z) / area;
+		const float dzdy = (edgeB[0] * v[0].Z + edgeB[1] * v[1].Z + edgeB[2] * v[2].Z) / area;
+		// Farthest depth of the plane over the cell, found the same way, never beyond the farthest vertex.
+		const float z0 = v[0].Z - dzdx * v[0].X - dzdy * v[0].Y + std::max<float>(dzdx, 0.0f) + std::max<float>(dzdy, 0.0f);
+		const float zMax = std::max<float>(v[0].Z, std::max<float>(v[1].Z, v[2].Z));
+
+		for (int y = minY; y < maxY; y++) {
+			float* row = m_Depth.data() + (size_t)y * m_Width;
+			for (int x = minX; x < maxX; x++) {
+				const float fx = (float)x, fy = (float)y;
+				if (edgeA[0] * fx + edgeB[0] * fy + edgeC[0] < 0.0f ||
+					edgeA[1] * fx + edgeB[1] * fy + edgeC[1] < 0.0f ||
+					edgeA[2] * fx + edgeB[2] * fy + edgeC[2] < 0.0f)
+					continue;
+				row[x] = std::min<float>(row[x], std::min<float>(z0 + dzdx * fx + dzdy * fy, zMax));
+			}
+		}
+	}
+
+	bool OcclusionBuffer::IsVisible(const Mat4& matrix, const AABB& box) const {
+		if (box.IsEmpty())
+			return false;
+
+		float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+		float nearest = FLT_MAX;
+		for (int i = 0; i < 8; i++) {
+			const Vec4 corner(
+				(i & 1) ? box.Max.X : box.Min.X,
+				(i & 2) ? box.Max.Y : box.Min.Y,
+				(i & 4) ? box.Max.Z : box.Min.Z, 1.0f);
+			const Vec4 clip = matrix * corner;
+			// A box reaching behind the eye can cover anything.
+			if (clip.W <= EPSILON)
+				return true;
+			const float invW = 1.0f / clip.W;
+			const float x = (clip.X * invW * 0.5f + 0.5f) * m_Width;
+			const float y = (clip.Y * invW * 0.5f + 0.5f) * m_Height;
+			minX = std::min<float>(minX, x);
+			maxX = std::max<float>(maxX, x);
+			minY = std::min<float>(minY, y);
+			maxY = std::max<float>(maxY, y);
+			nearest = std::min<float>(nearest, clip.Z * invW * 0.5f + 0.5f);
+		}
+
+		const int x0 = std::max<int>((int)std::floor(minX), 0);
+		const int x1 = std::min<int>((int)std::ceil(maxX), m_Width);
+		const int y0 = std::max<int>((int)std::floor(minY), 0);
+		const int y1 = std::min<int>((int)std::ceil(maxY), m_Height);
+		if (x0 >= x1 || y0 >= y1)
+			return false;
+
+		// Farthest occluder per row first, a branch-free loop the compiler can vectorize.
+		for (int y = y0; y < y1; y++) {
+			const float* row = m_Depth.data() + (size_t)y * m_Width;
+			float farthest = 0.0f;
+			for (int x = x0; x < x1; x++)
+				farthest = row[x] > farthest ? row[x] : farthest;
+			if (farthest >= nearest)
+				return true;
+		}
+		return false;
+	}
+
+}
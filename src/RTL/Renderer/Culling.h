@@ -0,0 +1,182 @@
+#pragma once
+
+#include "RTL/Base/Maths.h"
+
+#include <vector>
+#include <cfloat>
+#include <cstdint>
+#include <algorithm>
+
+#define RTL_CLUSTER_TRIANGLES 128
+#define RTL_OCCLUSION_WIDTH 256
+#define RTL_OCCLUSION_HEIGHT 128
+#define RTL_OCCLUSION_MAX_OCCLUDERS 1024
+
+namespace RTL {
+
+	struct AABB {
+		Vec3 Min = Vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+		Vec3 Max = Vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+
+		void Expand(const Vec3& point);
+		void Expand(const AABB& box);
+		bool IsEmpty() const { return Min.X > Max.X; }
+		Vec3 GetCenter() const { return (Min + Max) * 0.5f; }
+	};
+
+	struct BoundingSphere {
+		Vec3 Center = Vec3(0.0f, 0.0f, 0.0f);
+		float Radius = 0.0f;
+	};
+
+	// Planes of the clip volume of a matrix, bounds are tested in the space the matrix transforms from,
+	// so an MVP tests model-space bounds without transforming them.
+	class Frustum {
+	public:
+		Frustum() = default;
+		explicit Frustum(const Mat4& matrix);
+
+		// Conservative, false only when the volume is completely outside one plane.
+		bool IsVisible(const AABB& box) const;
+		bool IsVisible(const BoundingSphere& sphere) const;
+
+	private:
+		// (normal, distance) with unit normals pointing inside.
+		Vec4 m_Planes[6];
+	};
+
+	// Small window-depth buffer of occluders. A cell is written only when an occluder covers all of it, with the
+	// farthest depth the occluder has over the cell, so a box is never rejected by mistake. Edges shared by two
+	// occluder triangles leave uncovered cells, which only make culling weaker.
+	class OcclusionBuffer {
+	public:
+		OcclusionBuffer(const int width = RTL_OCCLUSION_WIDTH, const int height = RTL_OCCLUSION_HEIGHT);
+
+		void Clear();
+		// Clip-space vertices, triangles crossing the near plane are skipped. Like the renderer, clockwise triangles
+		// are back faces and occlude nothing unless doubleSided, so an open mesh never hides what is behind it.
+		void RasterizeTriangle(const Vec4& clip0, const Vec4& clip1, const Vec4& clip2, const bool doubleSided = false);
+		// False when every cell under the projected box holds an occluder nearer than the box.
+		bool IsVisible(const Mat4& matrix, const AABB& box) const;
+
+		int GetWidth() const { return m_Width; }
+		int GetHeight() const { return m_Height; }
+		const float* GetDepthData() const { return m_Depth.data(); }
+
+	private:
+		int m_Width, m_Height;
+		std::vector<float> m_Depth;
+	};
+
+	struct CullingStats {
+		uint32_t ClusterCount = 0;
+		uint32_t FrustumCulled = 0;
+		uint32_t BackfaceCulled = 0;
+		uint32_t OcclusionCulled = 0;
+		uint32_t OccluderTriangles = 0;
+		uint32_t DrawnTriangles = 0;
+	};
+
+	// A meshlet: a contiguous range of mesh triangles, its bounds and the cone containing its face normals.
+	struct MeshCluster {
+		uint32_t Begin = 0, End = 0;
+		AABB Box;
+		BoundingSphere Sphere;
+
+		// ConeCutoff is the sine of the cone's half angle, 1 when the normals spread too far for a cone test.
+		Vec3 ConeAxis = Vec3(0.0f, 0.0f, 0.0f);
+		float ConeCutoff = 1.0f;
+	};
+
+	uint32_t GetMortonCode(const Vec3& position, const AABB& bounds);
+	// 0 to 5 for a normal mostly along +X, -X, +Y, -Y, +Z, -Z.
+	uint32_t GetDominantAxis(const Vec3& normal);
+	MeshCluster MergeMeshClusters(const std::vector<MeshCluster>& clusters);
+	void ComputeNormalCone(MeshCluster& cluster, const std::vector<Vec3>& faceNormals);
+
+	// The point a perspective matrix maps to X = Y = W = 0, i.e. the eye in the space the matrix transforms from.
+	// False for matrices without one, such as orthographic projections.
+	bool GetEyePosition(const Mat4& matrix, Vec3& eye);
+
+	// True when every triangle of the cluster faces away from eye, counter-clockwise triangles being front faces.
+	bool IsClusterBackFacing(const MeshCluster& cluster, const Vec3& eye);
+
+	// Groups triangles by the axis their face normal is closest to, then orders each group along a Morton curve of the
+	// centroids, so consecutive triangles are close in space and face roughly the same way.
+	template<typename mesh_t>
+	void SortMeshSpatially(mesh_t& mesh) {
+		AABB bounds;
+		std::vector<Vec3> centroids(mesh.size());
+		for (size_t i = 0; i < mesh.size(); i++) {
+			centroids[i] = (Vec3(mesh[i][0].ModelPos) + Vec3(mesh[i][1].ModelPos) + Vec3(mesh[i][2].ModelPos)) / 3.0f;
+			bounds.Expand(centroids[i]);
+		}
+
+		std::vector<std::pair<uint64_t, uint32_t>> keys(mesh.size());
+		for (size_t i = 0; i < mesh.size(); i++) {
+			const Vec3 a = Vec3(mesh[i][0].ModelPos);
+			const uint64_t axis = GetDominantAxis(Cross(Vec3(mesh[i][1].ModelPos) - a, Vec3(mesh[i][2].ModelPos) - a));
+			keys[i] = { (axis << 32) | GetMortonCode(centroids[i], bounds), (uint32_t)i };
+		}
+		std::sort(keys.begin(), keys.end());
+
+		mesh_t sorted;
+		sorted.reserve(mesh.size());
+		for (const auto& key : keys)
+			sorted.push_back(mesh[key.second]);
+		mesh.swap(sorted);
+	}
+
+	template<typename mesh_t>
+	std::vector<MeshCluster> BuildMeshClusters(const mesh_t& mesh, const uint32_t clusterSize = RTL_CLUSTER_TRIANGLES) {
+		std::vector<MeshCluster> clusters;
+		std::vector<Vec3> faceNormals;
+		for (uint32_t begin = 0; begin < (uint32_t)mesh.size(); begin += clusterSize) {
+			MeshCluster cluster;
+			cluster.Begin = begin;
+			cluster.End = std::min<uint32_t>(begin + clusterSize, (uint32_t)mesh.size());
+			for (uint32_t i = cluster.Begin; i < cluster.End; i++) {
+				for (int j = 0; j < 3; j++)
+					cluster.Box.Expand(Vec3(mesh[i][j].ModelPos));
+			}
+
+			cluster.Sphere.Center = cluster.Box.GetCenter();
+			faceNormals.clear();
+			for (uint32_t i = cluster.Begin; i < cluster.End; i++) {
+				const Vec3 a = Vec3(mesh[i][0].ModelPos);
+				const Vec3 b = Vec3(mesh[i][1].ModelPos);
+				const Vec3 c = Vec3(mesh[i][2].ModelPos);
+				cluster.Sphere.Radius = std::max<float>(cluster.Sphere.Radius, Length(a - cluster.Sphere.Center));
+				cluster.Sphere.Radius = std::max<float>(cluster.Sphere.Radius, Length(b - cluster.Sphere.Center));
+				cluster.Sphere.Radius = std::max<float>(cluster.Sphere.Radius, Length(c - cluster.Sphere.Center));
+				faceNormals.push_back(Cross(b - a, c - a));
+			}
+			ComputeNormalCone(cluster, faceNormals);
+			clusters.push_back(cluster);
+		}
+		return clusters;
+	}
+
+	// Positions of the largest triangles of a mesh, three per triangle. Only triangles covering whole cells of
+	// the occlusion buffer hide anything, so a few large ones stand in for the mesh as its occluders.
+	template<typename mesh_t>
+	std::vector<Vec3> SelectOccluders(const mesh_t& mesh, const size_t maxTriangles = RTL_OCCLUSION_MAX_OCCLUDERS) {
+		std::vector<std::pair<float, uint32_t>> areas(mesh.size());
+		for (uint32_t i = 0; i < (uint32_t)mesh.size(); i++) {
+			const Vec3 a = Vec3(mesh[i][0].ModelPos);
+			areas[i] = { Length(Cross(Vec3(mesh[i][1].ModelPos) - a, Vec3(mesh[i][2].ModelPos) - a)), i };
+		}
+		const size_t count = std::min<size_t>(maxTriangles, areas.size());
+		std::nth_element(areas.begin(), areas.begin() + count, areas.end(),
+			[](const std::pair<float, uint32_t>& a, const std::pair<float, uint32_t>& b) { return a.first > b.first; });
+
+		std::vector<Vec3> occluders;
+		occluders.reserve(count * 3);
+		for (size_t i = 0; i < count; i++) {
+			for (int j = 0; j < 3; j++)
+				occluders.push_back(Vec3(mesh[areas[i].second][j].ModelPos));
+		}
+		return occluders;
+	}
+
+}
@@ -1,5 +1,7 @@
 #include "Renderer.h"
 
+#include <cfloat>
+
 namespace RTL {
 
 	bool Renderer::IsVertexVisible(const Vec4& clipPos) {
@@ -38,19 +40,6 @@ namespace RTL {
 		return signedArea <= 0.0f;
 	}
 
-	bool Renderer::PassDepthTest(const float writeDepth, const float fDepth, const DepthFuncType depthFuncType) {
-		switch (depthFuncType) {
-		case DepthFuncType::LESS:
-			return fDepth - writeDepth > EPSILON;
-		case DepthFuncType::LEQUAL:
-			return fDepth - writeDepth >= EPSILON;
-		case DepthFuncType::ALWAYS:
-			return true;
-		default:
-			return false;
-		}
-	}
-
 	float Renderer::GetIntersectRatio(const Vec4& prev, const Vec4& curr, const Plane plane) {
 		switch (plane) {
 		case Plane::POSITIVE_W:
@@ -119,4 +108,37 @@ namespace RTL {
 		weights[2] = w2 * normalizer;
 	}
 
+	// Columns (X, Y, W) of a, b, c map weights to the homogeneous pixel point, so the weights are the
+	// inverse matrix applied to (ndc, 1): one cross product per row.
+	void Renderer::CalculateHomogeneousWeights(float(&weights)[3], const Vec4& a, const Vec4& b, const Vec4& c, const Vec2& ndc) {
+		const Vec3 p(ndc.X, ndc.Y, 1.0f);
+		const Vec3 ha(a.X, a.Y, a.W);
+		const Vec3 hb(b.X, b.Y, b.W);
+		const Vec3 hc(c.X, c.Y, c.W);
+
+		float w0 = Dot(p, Cross(hb, hc));
+		float w1 = Dot(p, Cross(hc, ha));
+		float w2 = Dot(p, Cross(ha, hb));
+		float normalizer = 1.0f / (w0 + w1 + w2);
+		weights[0] = w0 * normalizer;
+		weights[1] = w1 * normalizer;
+		weights[2] = w2 * normalizer;
+	}
+
+	void Renderer::GetRowRange(const Vec4(&clipPos)[3], const int height, int& rowBegin, int& rowEnd) {
+		rowBegin = 0;
+		rowEnd = height;
+		if (clipPos[0].W <= EPSILON || clipPos[1].W <= EPSILON || clipPos[2].W <= EPSILON)
+			return;
+
+		float minY = FLT_MAX, maxY = -FLT_MAX;
+		for (int i = 0; i < 3; i++) {
+			const float y = (clipPos[i].Y / clipPos[i].W + 1.0f) * 0.5f * height;
+			minY = std::min<float>(minY, y);
+			maxY = std::max<float>(maxY, y);
+		}
+		rowBegin = (int)Clamp(std::floor(minY), 0.0f, (float)height);
+		rowEnd = (int)Clamp(std::ceil(maxY) + 1.0f, 0.0f, (float)height);
+	}
+
 }
@@ -1,9 +1,12 @@
 #include "RTL/Base/Maths.h"
+#include "RTL/Base/Parallel.h"
 #include "RTL/Window/Framebuffer.h"
 
 #include <memory>
 
 #define RTL_MAX_VARYINGS 9
+#define RTL_VISIBILITY_TRIANGLE_BITS 24
+#define RTL_VISIBILITY_CACHE_SIZE 8
 
 namespace RTL {
 
@@ -17,6 +20,7 @@ namespace RTL {
 		Triangle() = default;
 	};
 
+	// Compares by distance to the camera, the framebuffer's DepthFormat decides the stored ordering.
 	enum class DepthFuncType {
 		LESS,
 		LEQUAL,
@@ -30,6 +34,8 @@ namespace RTL {
 		bool EnableDepthTest = true;
 		bool EnableWriteDepth = true;
 		bool EnableBlend = true;
+		// Skips tile blocks whose stored depth already rejects the triangle's nearest vertex.
+		bool EnableBlockDepthCull = false;
 
         DepthFuncType DepthFunc = DepthFuncType::LESS;
 
@@ -58,11 +64,33 @@ namespace RTL {
 
 		struct BoundingBox { int MinX, MaxX, MinY, MaxY; };
 
+		// Position-only varyings for the depth-only path.
+		struct DepthVaryings {
+			Vec4 ClipPos;
+			Vec4 NdcPos;
+			Vec4 FragPos;
+		};
+
 		static bool IsVertexVisible(const Vec4& clipPos);
 		static bool IsInsidePlane(const Vec4& clipPos, const Plane plane);
 		static bool IsInsideTriangle(float(&weights)[3]);
 		static bool IsBackFacing(const Vec4& a, const Vec4& b, const Vec4& c);
-		static bool PassDepthTest(const float writeDepth, const float fDepth, const DepthFuncType depthFuncType);
+
+		template<typename depth_traits_t>
+		static bool PassDepthTest(const typename depth_traits_t::depth_t writeDepth,
+								  const typename depth_traits_t::depth_t fDepth,
+								  const DepthFuncType depthFuncType) {
+			switch (depthFuncType) {
+			case DepthFuncType::LESS:
+				return depth_traits_t::Less(writeDepth, fDepth);
+			case DepthFuncType::LEQUAL:
+				return depth_traits_t::LessEqual(writeDepth, fDepth);
+			case DepthFuncType::ALWAYS:
+				return true;
+			default:
+				return false;
+			}
+		}
 
 		static float GetIntersectRatio(const Vec4& prev, const Vec4& curr, const Plane plane);
 		static BoundingBox GetBoundingBox(const Vec4(&fragCoord)[3], const int width, const int height);
@@ -188,36 +216,63 @@ namespace RTL {
 			}
 		}
 
-		template<typename vertex_t, typename varyings_t, typename uniforms_t>
-		static void ProcessPixel(Framebuffer* framebuffer, const int x, const int y,
+		template<typename depth_traits_t>
+		static typename depth_traits_t::depth_t GetNearestDepth(const Vec4(&clipPos)[3]) {
+			typename depth_traits_t::depth_t nearest = depth_traits_t::Encode(depth_traits_t::GetFragmentDepth(clipPos[0]));
+			for (int i = 1; i < 3; i++)
+				nearest = depth_traits_t::GetNearer(nearest, depth_traits_t::Encode(depth_traits_t::GetFragmentDepth(clipPos[i])));
+			return nearest;
+		}
+
+		// Depth is bounded by the vertices over a triangle, so if the nearest one fails against every stored
+		// value of the block no fragment of the triangle can pass there.
+		template<typename depth_traits_t>
+		static bool IsBlockOccluded(const Framebuffer* framebuffer,
+									const typename depth_traits_t::depth_t* depthData,
+									const typename depth_traits_t::depth_t nearest,
+									const DepthFuncType depthFunc,
+									const int blockX, const int blockY, const int blockMaxX, const int blockMaxY) {
+			const int tile = framebuffer->GetTileIndex(blockX, blockY);
+			if (depthFunc == DepthFuncType::ALWAYS || framebuffer->IsDepthTileCleared(tile))
+				return false;
+			framebuffer->AcquireDepthTile(tile);
+			for (int y = blockY; y < blockMaxY; y++) {
+				for (int x = blockX; x < blockMaxX; x++) {
+					if (PassDepthTest<depth_traits_t>(nearest, depthData[framebuffer->GetPixelIndex(x, y)], depthFunc))
+						return false;
+				}
+			}
+			return true;
+		}
+
+		// The color format is resolved by the caller once per draw, not per fragment.
+		template<typename color_traits_t, typename vertex_t, typename varyings_t, typename uniforms_t>
+		static bool ProcessPixel(typename color_traits_t::pixel_t* colorData, const int index,
 			const Program<vertex_t, varyings_t, uniforms_t>& program,
 			const varyings_t& varyings, const uniforms_t& uniforms) {
 
 			bool discard = false;
 			Vec4 color{ 0.0f };
 			color = program.FragmentShader(discard, varyings, uniforms);
-			if (discard) return;
+			if (discard) return false;
 			color.X = Clamp(color.X, 0.0f, 1.0f);
 			color.Y = Clamp(color.Y, 0.0f, 1.0f);
 			color.Z = Clamp(color.Z, 0.0f, 1.0f);
 			color.W = Clamp(color.W, 0.0f, 1.0f);
 
 			if (program.EnableBlend)
-				color = { Lerp(framebuffer->GetColor(x, y), color, color.W), 1.0f };
-
-			framebuffer->SetColor(x, y, color);
-
-			if (program.EnableWriteDepth) {
-				float depth = varyings.ClipPos.Z;
-				framebuffer->SetDepth(x, y, depth);
-			}
+				color_traits_t::Blend(colorData[index], color, color.W);
+			else
+				colorData[index] = color_traits_t::Encode(color);
+			return true;
 		}
 
-		template<typename vertex_t, typename uniforms_t, typename varyings_t>
+		// processPixel(index, varyings) shades a fragment that passed the depth test and returns false if it discarded.
+		template<typename vertex_t, typename uniforms_t, typename varyings_t, typename pixel_func_t>
 		static void RasterizeTriangle(Framebuffer* framebuffer,
 									  const Program<vertex_t, varyings_t, uniforms_t>& program,
 									  const varyings_t(&varyings)[3],
-									  const uniforms_t& uniforms) {
+									  const pixel_func_t& processPixel) {
 
 			if (!program.EnableDoubleSided) {
 				bool isBackFacing = false;
@@ -230,34 +285,137 @@ namespace RTL {
 			float height = (float)framebuffer->GetHeight();
 			BoundingBox bbox = GetBoundingBox(fragCoord, (int)width, (int)height);
 
-			for (int y = bbox.MinY; y < bbox.MaxY; y++) {
-				for (int x = bbox.MinX; x < bbox.MaxX; x++) {
-					float screenWeights[3];
-					float weights[3];
-					Vec2 screenPoint = { (float)x + 0.5f, (float)y + 0.5f };
+			DispatchDepthFormat(framebuffer->GetDepthFormat(), [&](auto depthTraits) {
+				using depth_traits_t = decltype(depthTraits);
+				typename depth_traits_t::depth_t* depthData = framebuffer->GetDepthData<depth_traits_t>();
+
+				const bool cullBlocks = program.EnableDepthTest && program.EnableBlockDepthCull;
+				const Vec4 clipPos[3] = { varyings[0].ClipPos, varyings[1].ClipPos, varyings[2].ClipPos };
+				const typename depth_traits_t::depth_t nearest = GetNearestDepth<depth_traits_t>(clipPos);
+
+				// Walk the box one tile-aligned block at a time so consecutive pixels share cache lines in either layout.
+				for (int blockY = bbox.MinY; blockY < bbox.MaxY; blockY = (blockY | RTL_TILE_MASK) + 1) {
+					const int blockMaxY = std::min<int>((blockY | RTL_TILE_MASK) + 1, bbox.MaxY);
+					for (int blockX = bbox.MinX; blockX < bbox.MaxX; blockX = (blockX | RTL_TILE_MASK) + 1) {
+						const int blockMaxX = std::min<int>((blockX | RTL_TILE_MASK) + 1, bbox.MaxX);
+						if (cullBlocks && IsBlockOccluded<depth_traits_t>(framebuffer, depthData, nearest, program.DepthFunc,
+																		  blockX, blockY, blockMaxX, blockMaxY))
+							continue;
+
+						bool tileAcquired = false;
+						for (int y = blockY; y < blockMaxY; y++) {
+							for (int x = blockX; x < blockMaxX; x++) {
+								float screenWeights[3];
+								float weights[3];
+								Vec2 screenPoint = { (float)x + 0.5f, (float)y + 0.5f };
+
+								CalculateWeights(screenWeights, weights, fragCoord, screenPoint);
+								if (!IsInsideTriangle(weights))
+									continue;
+
+								varyings_t pixVaryings;
+								LerpVaryings(pixVaryings, varyings, weights, (int)width, (int)height);
+
+								if (!tileAcquired) {
+									const int tile = framebuffer->GetTileIndex(blockX, blockY);
+									framebuffer->AcquireColorTile(tile);
+									framebuffer->AcquireDepthTile(tile);
+									tileAcquired = true;
+								}
+
+								const int index = framebuffer->GetPixelIndex(x, y);
+								const typename depth_traits_t::depth_t depth =
+									depth_traits_t::Encode(depth_traits_t::GetFragmentDepth(pixVaryings.ClipPos));
+								if (program.EnableDepthTest) {
+									DepthFuncType depthFunc = program.DepthFunc;
+									if (!PassDepthTest<depth_traits_t>(depth, depthData[index], depthFunc)) continue;
+								}
+
+								if (processPixel(index, pixVaryings) && program.EnableWriteDepth)
+									depthData[index] = depth;
+							}
+						}
+					}
+				}
+			});
+		}
 
-					CalculateWeights(screenWeights, weights, fragCoord, screenPoint);
-					if (!IsInsideTriangle(weights))
-						continue;
+		// Interpolates only clip Z and W, touches neither the fragment shader nor the color buffer.
+		// Only rows [rowBegin, rowEnd) are written; onPass(index) runs for every fragment that passed the depth test.
+		template<typename vertex_t, typename varyings_t, typename uniforms_t, typename pass_func_t>
+		static void RasterizeDepth(Framebuffer* framebuffer,
+								   const Program<vertex_t, varyings_t, uniforms_t>& program,
+								   const DepthVaryings(&varyings)[3],
+								   const int rowBegin, const int rowEnd,
+								   const pass_func_t& onPass) {
 
-					varyings_t pixVaryings;
-					LerpVaryings(pixVaryings, varyings, weights, (int)width, (int)height);
+			if (!program.EnableDoubleSided) {
+				if (IsBackFacing(varyings[0].NdcPos, varyings[1].NdcPos, varyings[2].NdcPos))
+					return;
+			}
 
-					if (program.EnableDepthTest) {
-						float depth = pixVaryings.ClipPos.Z;
-						float fDepth = framebuffer->GetDepth(x, y);
-						DepthFuncType depthFunc = program.DepthFunc;
-						if (!PassDepthTest(depth, fDepth, depthFunc)) continue;
+			Vec4 fragCoord[3] = { varyings[0].FragPos, varyings[1].FragPos, varyings[2].FragPos };
+			const Vec4 clipPos[3] = { varyings[0].ClipPos, varyings[1].ClipPos, varyings[2].ClipPos };
+			BoundingBox bbox = GetBoundingBox(fragCoord, framebuffer->GetWidth(), framebuffer->GetHeight());
+			bbox.MinY = std::max<int>(bbox.MinY, rowBegin);
+			bbox.MaxY = std::min<int>(bbox.MaxY, rowEnd);
+
+			DispatchDepthFormat(framebuffer->GetDepthFormat(), [&](auto depthTraits) {
+				using depth_traits_t = decltype(depthTraits);
+				typename depth_traits_t::depth_t* depthData = framebuffer->GetDepthData<depth_traits_t>();
+
+				const bool cullBlocks = program.EnableDepthTest && program.EnableBlockDepthCull;
+				const typename depth_traits_t::depth_t nearest = GetNearestDepth<depth_traits_t>(clipPos);
+
+				for (int blockY = bbox.MinY; blockY < bbox.MaxY; blockY = (blockY | RTL_TILE_MASK) + 1) {
+					const int blockMaxY = std::min<int>((blockY | RTL_TILE_MASK) + 1, bbox.MaxY);
+					for (int blockX = bbox.MinX; blockX < bbox.MaxX; blockX = (blockX | RTL_TILE_MASK) + 1) {
+						const int blockMaxX = std::min<int>((blockX | RTL_TILE_MASK) + 1, bbox.MaxX);
+						if (cullBlocks && IsBlockOccluded<depth_traits_t>(framebuffer, depthData, nearest, program.DepthFunc,
+																		  blockX, blockY, blockMaxX, blockMaxY))
+							continue;
+
+						bool tileAcquired = false;
+						for (int y = blockY; y < blockMaxY; y++) {
+							for (int x = blockX; x < blockMaxX; x++) {
+								float screenWeights[3];
+								float weights[3];
+								Vec2 screenPoint = { (float)x + 0.5f, (float)y + 0.5f };
+
+								CalculateWeights(screenWeights, weights, fragCoord, screenPoint);
+								if (!IsInsideTriangle(weights))
+									continue;
+
+								if (!tileAcquired) {
+									framebuffer->AcquireDepthTile(framebuffer->GetTileIndex(blockX, blockY));
+									tileAcquired = true;
+								}
+
+								// Same expression as LerpVaryings so a later LEQUAL pass sees bit-identical depth.
+								Vec4 pixClipPos;
+								pixClipPos.Z = clipPos[0].Z * weights[0] + clipPos[1].Z * weights[1] + clipPos[2].Z * weights[2];
+								pixClipPos.W = clipPos[0].W * weights[0] + clipPos[1].W * weights[1] + clipPos[2].W * weights[2];
+
+								const int index = framebuffer->GetPixelIndex(x, y);
+								const typename depth_traits_t::depth_t depth =
+									depth_traits_t::Encode(depth_traits_t::GetFragmentDepth(pixClipPos));
+								if (program.EnableDepthTest && !PassDepthTest<depth_traits_t>(depth, depthData[index], program.DepthFunc))
+									continue;
+
+								if (program.EnableWriteDepth)
+									depthData[index] = depth;
+								onPass(index);
+							}
+						}
 					}
-
-					ProcessPixel(framebuffer, x, y, program, pixVaryings, uniforms);
 				}
-			}
+			});
 		}
 
-	public:
-		template<typename vertex_t, typename varyings_t, typename uniforms_t>
-		static void Draw(Framebuffer* framebuffer, const Program<vertex_t, varyings_t, uniforms_t>& program, const Triangle<vertex_t>& triangle, const uniforms_t& uniforms) {
+		template<typename vertex_t, typename varyings_t, typename uniforms_t, typename pixel_func_t>
+		static void DrawTriangle(Framebuffer* framebuffer, const Program<vertex_t, varyings_t, uniforms_t>& program,
+								 const Triangle<vertex_t>& triangle, const uniforms_t& uniforms,
+								 const pixel_func_t& processPixel) {
 			varyings_t varyings[RTL_MAX_VARYINGS];
 			for (int i = 0; i < 3; i++)
 				program.VertexShader(varyings[i], triangle[i], uniforms);
@@ -275,9 +433,203 @@ namespace RTL {
 					varyings[i + 1],
 					varyings[i + 2] };
 
-				RasterizeTriangle(framebuffer, program, triangles, uniforms);
+				RasterizeTriangle(framebuffer, program, triangles, processPixel);
 			}
 		}
+
+		template<typename vertex_t, typename varyings_t, typename uniforms_t, typename pass_func_t>
+		static void DrawDepthClipped(Framebuffer* framebuffer, const Program<vertex_t, varyings_t, uniforms_t>& program,
+									 const Vec4(&clipPos)[3], const int rowBegin, const int rowEnd, const pass_func_t& onPass) {
+			DepthVaryings varyings[RTL_MAX_VARYINGS];
+			for (int i = 0; i < 3; i++)
+				varyings[i].ClipPos = clipPos[i];
+
+			int vertexNum = Clip(varyings);
+
+			CalculateNdcPos(varyings, vertexNum);
+			CalculateFragPos(varyings, vertexNum, (float)framebuffer->GetWidth(), (float)framebuffer->GetHeight());
+
+			for (int i = 0; i < vertexNum - 2; i++) {
+				DepthVaryings triangles[3] = {
+					varyings[0],
+					varyings[i + 1],
+					varyings[i + 2] };
+
+				RasterizeDepth(framebuffer, program, triangles, rowBegin, rowEnd, onPass);
+			}
+		}
+
+		// Perspective-correct weights of an NDC point from unclipped clip positions (2D homogeneous rasterization),
+		// valid even when a vertex lies behind the camera.
+		static void CalculateHomogeneousWeights(float(&weights)[3], const Vec4& a, const Vec4& b, const Vec4& c, const Vec2& ndc);
+
+		// Calls func(index, x, y) for every pixel with depth written since the last clear, one tile per task.
+		// Coverage is read back from depth, so the draws must write depth, and a fragment that writes exactly the
+		// clear depth (LEQUAL or ALWAYS on the far plane) counts as uncovered.
+		// Each task works on its own copy of func, so a mutable func can keep per-thread state.
+		template<typename func_t>
+		static void ForEachCoveredPixel(Framebuffer* framebuffer, const func_t& func) {
+			const int tileCountX = framebuffer->GetTileCountX();
+			const int tileCount = tileCountX * framebuffer->GetTileCountY();
+
+			DispatchDepthFormat(framebuffer->GetDepthFormat(), [&](auto depthTraits) {
+				using depth_traits_t = decltype(depthTraits);
+				const typename depth_traits_t::depth_t* depthData = framebuffer->GetDepthData<depth_traits_t>();
+				const typename depth_traits_t::depth_t clearDepth = depth_traits_t::Encode(framebuffer->GetClearDepth());
+
+				ParallelFor(0, tileCount, [&](const int begin, const int end) {
+					func_t rangeFunc = func;
+					for (int tile = begin; tile < end; tile++) {
+						if (framebuffer->IsDepthTileCleared(tile))
+							continue;
+						framebuffer->AcquireDepthTile(tile);
+						framebuffer->AcquireColorTile(tile);
+
+						const int x0 = (tile % tileCountX) << RTL_TILE_SHIFT;
+						const int y0 = (tile / tileCountX) << RTL_TILE_SHIFT;
+						const int x1 = std::min<int>(x0 + RTL_TILE_SIZE, framebuffer->GetWidth());
+						const int y1 = std::min<int>(y0 + RTL_TILE_SIZE, framebuffer->GetHeight());
+						for (int y = y0; y < y1; y++) {
+							for (int x = x0; x < x1; x++) {
+								const int index = framebuffer->GetPixelIndex(x, y);
+								if (depthData[index] != clearDepth)
+									rangeFunc(index, x, y);
+							}
+						}
+					}
+				});
+			});
+		}
+
+	public:
+		template<typename varyings_t, typename uniforms_t, typename gbuffer_t>
+		using gbuffer_shader_t = void(*)(bool& discard, gbuffer_t& gbuffer, const varyings_t&, const uniforms_t&);
+
+		template<typename gbuffer_t, typename uniforms_t>
+		using lighting_shader_t = Vec3(*)(const gbuffer_t& gbuffer, const uniforms_t&);
+
+		template<typename vertex_t, typename varyings_t, typename uniforms_t>
+		static void Draw(Framebuffer* framebuffer, const Program<vertex_t, varyings_t, uniforms_t>& program, const Triangle<vertex_t>& triangle, const uniforms_t& uniforms) {
+			DispatchColorFormat(framebuffer->GetColorFormat(), [&](auto colorTraits) {
+				using color_traits_t = decltype(colorTraits);
+				typename color_traits_t::pixel_t* colorData = framebuffer->GetColorData<color_traits_t>();
+				DrawTriangle(framebuffer, program, triangle, uniforms, [&](const int index, const varyings_t& varyings) {
+					return ProcessPixel<color_traits_t>(colorData, index, program, varyings, uniforms);
+				});
+			});
+		}
+
+		// Geometry pass of deferred shading: writes gbuffer_t into render target `target` instead of shading.
+		// ShadeGBuffer finds covered pixels through depth, see ForEachCoveredPixel.
+		template<typename vertex_t, typename varyings_t, typename uniforms_t, typename gbuffer_t>
+		static void DrawGBuffer(Framebuffer* framebuffer, const int target,
+								const Program<vertex_t, varyings_t, uniforms_t>& program,
+								const gbuffer_shader_t<varyings_t, uniforms_t, gbuffer_t> gbufferShader,
+								const Triangle<vertex_t>& triangle, const uniforms_t& uniforms) {
+			ASSERT(program.EnableWriteDepth);
+			gbuffer_t* gbuffers = framebuffer->GetRenderTarget<gbuffer_t>(target);
+			DrawTriangle(framebuffer, program, triangle, uniforms, [&](const int index, const varyings_t& varyings) {
+				bool discard = false;
+				gbufferShader(discard, gbuffers[index], varyings, uniforms);
+				return !discard;
+			});
+		}
+
+		// Lighting pass of deferred shading: runs lightingShader once per covered pixel, one tile per task.
+		template<typename gbuffer_t, typename uniforms_t>
+		static void ShadeGBuffer(Framebuffer* framebuffer, const int target,
+								 const lighting_shader_t<gbuffer_t, uniforms_t> lightingShader,
+								 const uniforms_t& uniforms) {
+			const gbuffer_t* gbuffers = framebuffer->GetRenderTarget<gbuffer_t>(target);
+			DispatchColorFormat(framebuffer->GetColorFormat(), [&](auto colorTraits) {
+				using color_traits_t = decltype(colorTraits);
+				typename color_traits_t::pixel_t* colorData = framebuffer->GetColorData<color_traits_t>();
+				ForEachCoveredPixel(framebuffer, [&](const int index, const int x, const int y) {
+					colorData[index] = color_traits_t::Encode(Clamp(lightingShader(gbuffers[index], uniforms), 0.0f, 1.0f));
+				});
+			});
+		}
+
+		// Depth-only variant of Draw for Z-prepasses and shadow maps.
+		template<typename vertex_t, typename varyings_t, typename uniforms_t>
+		static void DrawDepth(Framebuffer* framebuffer, const Program<vertex_t, varyings_t, uniforms_t>& program, const Triangle<vertex_t>& triangle, const uniforms_t& uniforms) {
+			varyings_t shaded[3];
+			ShadeVertices(shaded, program, triangle, uniforms);
+			const Vec4 clipPos[3] = { shaded[0].ClipPos, shaded[1].ClipPos, shaded[2].ClipPos };
+			DrawDepthClipped(framebuffer, program, clipPos, 0, framebuffer->GetHeight(), [](const int) {});
+		}
+
+		static uint32_t PackVisibilityID(const uint32_t draw, const uint32_t triangle) {
+			ASSERT(draw < (1u << (32 - RTL_VISIBILITY_TRIANGLE_BITS)) && triangle < (1u << RTL_VISIBILITY_TRIANGLE_BITS));
+			return (draw << RTL_VISIBILITY_TRIANGLE_BITS) | triangle;
+		}
+		static uint32_t GetVisibilityDraw(const uint32_t id) { return id >> RTL_VISIBILITY_TRIANGLE_BITS; }
+		static uint32_t GetVisibilityTriangle(const uint32_t id) { return id & ((1u << RTL_VISIBILITY_TRIANGLE_BITS) - 1); }
+
+		template<typename vertex_t, typename varyings_t, typename uniforms_t>
+		static void ShadeVertices(varyings_t(&shaded)[3], const Program<vertex_t, varyings_t, uniforms_t>& program,
+								  const Triangle<vertex_t>& triangle, const uniforms_t& uniforms) {
+			for (int i = 0; i < 3; i++)
+				program.VertexShader(shaded[i], triangle[i], uniforms);
+		}
+
+		// Rows [rowBegin, rowEnd) a clip-space triangle can cover, every row when a vertex is behind the eye.
+		static void GetRowRange(const Vec4(&clipPos)[3], const int height, int& rowBegin, int& rowEnd);
+
+		// Visibility pass: rasterizes a triangle from its clip positions within rows [rowBegin, rowEnd), writing
+		// only depth and a PackVisibilityID id into the uint32_t render target `target`. Depth and id are two
+		// stores, so threads must own disjoint rows rather than disjoint triangles. No fragment shader runs here,
+		// so alpha-tested materials would occlude with their full triangle and cannot use this path.
+		template<typename vertex_t, typename varyings_t, typename uniforms_t>
+		static void DrawVisibility(Framebuffer* framebuffer, const int target,
+								   const Program<vertex_t, varyings_t, uniforms_t>& program,
+								   const Vec4(&clipPos)[3], const uint32_t id, const int rowBegin, const int rowEnd) {
+			ASSERT(program.EnableWriteDepth);
+			uint32_t* ids = framebuffer->GetRenderTarget<uint32_t>(target);
+			DrawDepthClipped(framebuffer, program, clipPos, rowBegin, rowEnd, [ids, id](const int index) { ids[index] = id; });
+		}
+
+		// Material pass of visibility rendering: shadeTriangle(id, shaded) runs the vertex shader again for the
+		// triangle of that id, barycentrics are rebuilt from its clip positions and the fragment shader runs once
+		// per pixel. Neighbouring pixels mostly share triangles, so each task caches its last few.
+		// The visibility pass has already kept the nearest id, so fragment shaders that discard are unsupported.
+		template<typename vertex_t, typename varyings_t, typename uniforms_t, typename shade_func_t>
+		static void ResolveVisibility(Framebuffer* framebuffer, const int target,
+									  const Program<vertex_t, varyings_t, uniforms_t>& program,
+									  const uniforms_t& uniforms, const shade_func_t& shadeTriangle) {
+			const uint32_t* ids = framebuffer->GetRenderTarget<uint32_t>(target);
+			const int width = framebuffer->GetWidth();
+			const int height = framebuffer->GetHeight();
+
+			struct ShadedCache {
+				uint32_t Ids[RTL_VISIBILITY_CACHE_SIZE];
+				varyings_t Varyings[RTL_VISIBILITY_CACHE_SIZE][3];
+				ShadedCache() { std::fill(Ids, Ids + RTL_VISIBILITY_CACHE_SIZE, UINT32_MAX); }
+			};
+
+			DispatchColorFormat(framebuffer->GetColorFormat(), [&](auto colorTraits) {
+				using color_traits_t = decltype(colorTraits);
+				typename color_traits_t::pixel_t* colorData = framebuffer->GetColorData<color_traits_t>();
+				ForEachCoveredPixel(framebuffer, [&, cache = ShadedCache()](const int index, const int x, const int y) mutable {
+					const uint32_t id = ids[index];
+					const int slot = (int)(id % RTL_VISIBILITY_CACHE_SIZE);
+					if (cache.Ids[slot] != id) {
+						shadeTriangle(id, cache.Varyings[slot]);
+						cache.Ids[slot] = id;
+					}
+					const varyings_t(&shaded)[3] = cache.Varyings[slot];
+					const Vec2 ndc = { ((float)x + 0.5f) / width * 2.0f - 1.0f, ((float)y + 0.5f) / height * 2.0f - 1.0f };
+
+					float weights[3];
+					CalculateHomogeneousWeights(weights, shaded[0].ClipPos, shaded[1].ClipPos, shaded[2].ClipPos, ndc);
+
+					varyings_t pixVaryings;
+					LerpVaryings(pixVaryings, shaded, weights, width, height);
+					const bool written = ProcessPixel<color_traits_t>(colorData, index, program, pixVaryings, uniforms);
+					ASSERT(written);
+				});
+			});
+		}
 	};
 
 }
@@ -16,11 +16,11 @@ namespace RTL {
 		return float(bits) * (float)2.3283064365386963e-10;
 	}
 
-	static Vec2 Hammersley(uint32_t i, uint32_t N) {
+	Vec2 Hammersley(uint32_t i, uint32_t N) {
 		return Vec2(float(i) / float(N), RadicalInverse_VdC(i));
 	}
 
-	static Vec3 ImportanceSampleGGX(Vec2 Xi, Vec3 N, float roughness) {
+	Vec3 ImportanceSampleGGX(Vec2 Xi, Vec3 N, float roughness) {
 		float a = roughness * roughness;
 
 		float phi = 2.0f * PI * Xi.X;
@@ -59,7 +59,7 @@ namespace RTL {
 		return ggx1 * ggx2;
 	}
 
-	static Vec2 IntegrateBRDF(float NdotV, float roughness) {
+	Vec2 IntegrateBRDF(float NdotV, float roughness, uint32_t sampleCount) {
 		Vec3 V;
 		V.X = sqrt(1.0f - NdotV * NdotV);
 		V.Y = 0.0f;
@@ -70,10 +70,9 @@ namespace RTL {
 
 		Vec3 N = Vec3(0.0f, 0.0f, 1.0f);
 
-		constexpr uint32_t SAMPLE_COUNT = 1024u;
-		for (uint32_t i = 0u; i < SAMPLE_COUNT; ++i)
+		for (uint32_t i = 0u; i < sampleCount; ++i)
 		{
-			Vec2 Xi = Hammersley(i, SAMPLE_COUNT);
+			Vec2 Xi = Hammersley(i, sampleCount);
 			Vec3 H = ImportanceSampleGGX(Xi, N, roughness);
 			Vec3 L = Normalize(2.0f * Dot(V, H) * H - V);
 
@@ -91,8 +90,8 @@ namespace RTL {
 				B += Fc * G_Vis;
 			}
 		}
-		A /= float(SAMPLE_COUNT);
-		B /= float(SAMPLE_COUNT);
+		A /= float(sampleCount);
+		B /= float(sampleCount);
 		return Vec2{ A, B };
 	}
 
@@ -18,6 +18,11 @@ namespace RTL {
 	void BRDFVertexShader(BRDFVaryings& varyings, const BRDFVertex& vertex, const BRDFUniforms& uniforms);
 	Vec4 BRDFFragmentShader(bool& discard, const BRDFVaryings& varyings, const BRDFUniforms& uniforms);
 
+	// Split-sum helpers, shared with the IBL baker.
+	Vec2 Hammersley(uint32_t i, uint32_t N);
+	Vec3 ImportanceSampleGGX(Vec2 Xi, Vec3 N, float roughness);
+	Vec2 IntegrateBRDF(float NdotV, float roughness, uint32_t sampleCount = 1024u);
+
 	void BRDFOnUpdate(BRDFUniforms& uniforms);
 	void BRDFInit(BRDFUniforms& uniforms);
 
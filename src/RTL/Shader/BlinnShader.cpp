@@ -31,18 +31,23 @@ namespace RTL {
 		Vec3 diffuseSum = Vec3(0.0f, 0.0f, 0.0f);
 		Vec3 specularSum = Vec3(0.0f, 0.0f, 0.0f);
 
-		for (size_t i = 0; i < uniforms.Lights.size(); ++i) {
+		uniforms.LightTiles.ForEachLight(worldPos, uniforms.Lights.size(), [&](const size_t i) {
 			const BlinnLight& light = uniforms.Lights[i];
+			float dist = Length(light.Position - worldPos);
+			float range = GetLightRangeFactor(dist, light.Radius);
+			if (range <= 0.0f)
+				return;
+
 			Vec3 lightDir = Normalize(light.Position - worldPos);
 			Vec3 halfDir = Normalize(viewDir + lightDir);
-			float dist = Length(light.Position - worldPos);
+			float strength = light.Strength * range / sqrt(dist);
 
-			Vec3 diffuse = std::max(0.0f, Dot(worldNormal, lightDir)) * light.Diffuse * diffColor / sqrt(dist) * light.Strength;
-			Vec3 specular = (float)std::pow(std::max(0.0f, Dot(worldNormal, halfDir)), uniforms.Shininess) * light.Specular * specularStrength / sqrt(dist) * light.Strength;
+			Vec3 diffuse = std::max(0.0f, Dot(worldNormal, lightDir)) * light.Diffuse * diffColor * strength;
+			Vec3 specular = (float)std::pow(std::max(0.0f, Dot(worldNormal, halfDir)), uniforms.Shininess) * light.Specular * specularStrength * strength;
 
 			diffuseSum += diffuse;
 			specularSum += specular;
-		}
+		});
 
 		Vec3 result = (ambient + diffuseSum + specularSum);
 		return Vec4(result, 1.0f);
@@ -50,6 +55,10 @@ namespace RTL {
 
 	void BlinnOnUpdate(BlinnUniforms& uniforms) {
 		uniforms.ModelNormalWorld = Mat4Identity();
+		if (uniforms.EnableLightCulling)
+			uniforms.LightTiles.Build(uniforms.Lights, uniforms.ViewProj, uniforms.ViewportWidth, uniforms.ViewportHeight);
+		else
+			uniforms.LightTiles.Reset();
 	}
 	void BlinnInit(BlinnUniforms& uniforms) {
 
@@ -3,6 +3,7 @@
 
 #include "RTL/Base/Maths.h"
 #include "RTL/Shader/Texture.h"
+#include "RTL/Shader/LightGrid.h"
 
 #undef min
 #undef max
@@ -14,6 +15,7 @@ namespace RTL {
 		Vec3 Diffuse = Vec3(0.5f, 0.5f, 0.5f);
 		Vec3 Specular = Vec3(1.0f, 1.0f, 1.0f);
 		float Strength = 1.0f;
+		float Radius = 0.0f;
 	};
 
 	struct BlinnVertex : public VertexBase {
@@ -36,6 +38,10 @@ namespace RTL {
 		Texture* Specular = nullptr;
 
 		bool EnableLerpTexture = true;
+
+		// Rebuilt by BlinnOnUpdate, fragments then only visit the lights of their screen tile.
+		bool EnableLightCulling = false;
+		LightGrid LightTiles;
 	};
 
 	void BlinnVertexShader(BlinnVaryings& varyings, const BlinnVertex& vertex, const BlinnUniforms& uniforms);
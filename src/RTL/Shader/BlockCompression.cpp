@@ -0,0 +1,245 @@
+#include "BlockCompression.h"
+
+#include "RTL/Base/Base.h"
+#include "RTL/Base/Parallel.h"
+
+#include <stb_image/stb_dxt.h>
+#include <fstream>
+#include <cstring>
+
+namespace RTL {
+
+	int GetBlockSize(const TextureCompression compression) {
+		switch (compression) {
+		case TextureCompression::BC1:
+		case TextureCompression::BC4:
+			return 8;
+		case TextureCompression::BC3:
+		case TextureCompression::BC5:
+			return 16;
+		default:
+			return 0;
+		}
+	}
+
+	int GetCompressionChannels(const TextureCompression compression) {
+		switch (compression) {
+		case TextureCompression::BC1:
+			return 3;
+		case TextureCompression::BC3:
+			return 4;
+		case TextureCompression::BC4:
+			return 1;
+		case TextureCompression::BC5:
+			return 2;
+		default:
+			return 0;
+		}
+	}
+
+	void CompressBlocks(const uint8_t* pixels, const int width, const int height, const int channels,
+						const TextureCompression compression, uint8_t* blocks) {
+		ASSERT(pixels && blocks && channels >= 1 && channels <= 4);
+		const int blockSize = GetBlockSize(compression);
+		ASSERT(blockSize > 0);
+
+		const int blocksX = (width + RTL_BLOCK_DIM - 1) / RTL_BLOCK_DIM;
+		const int blocksY = (height + RTL_BLOCK_DIM - 1) / RTL_BLOCK_DIM;
+		ParallelFor(0, blocksY, [&](const int begin, const int end) {
+			// Gathered as RGBA regardless of format, BC4 and BC5 read the first one or two bytes of each texel.
+			uint8_t rgba[16 * 4];
+			uint8_t channel[16 * 2];
+			for (int by = begin; by < end; by++) {
+				for (int bx = 0; bx < blocksX; bx++) {
+					for (int i = 0; i < 16; i++) {
+						const int x = std::min<int>(bx * RTL_BLOCK_DIM + (i & 3), width - 1);
+						const int y = std::min<int>(by * RTL_BLOCK_DIM + (i >> 2), height - 1);
+						const uint8_t* src = pixels + (x + y * width) * channels;
+						for (int c = 0; c < 4; c++)
+							rgba[i * 4 + c] = c < channels ? src[c] : 0;
+					}
+
+					uint8_t* dst = blocks + (bx + by * blocksX) * blockSize;
+					switch (compression) {
+					case TextureCompression::BC1:
+						stb_compress_dxt_block(dst, rgba, 0, STB_DXT_NORMAL);
+						break;
+					case TextureCompression::BC3:
+						stb_compress_dxt_block(dst, rgba, 1, STB_DXT_NORMAL);
+						break;
+					case TextureCompression::BC4:
+						for (int i = 0; i < 16; i++)
+							channel[i] = rgba[i * 4];
+						stb_compress_bc4_block(dst, channel);
+						break;
+					case TextureCompression::BC5:
+						for (int i = 0; i < 16; i++) {
+							channel[i * 2] = rgba[i * 4];
+							channel[i * 2 + 1] = rgba[i * 4 + 1];
+						}
+						stb_compress_bc5_block(dst, channel);
+						break;
+					default:
+						break;
+					}
+				}
+			}
+		});
+	}
+
+	static uint32_t Expand565(const uint16_t color) {
+		const uint32_t r = (color >> 11) & 31;
+		const uint32_t g = (color >> 5) & 63;
+		const uint32_t b = color & 31;
+		return ((r << 3) | (r >> 2)) | (((g << 2) | (g >> 4)) << 8) | (((b << 3) | (b >> 2)) << 16);
+	}
+
+	// Weighted average of two RGB8 colors, per channel (a * wa + b * wb) / (wa + wb).
+	static uint32_t BlendRGB8(const uint32_t a, const uint32_t b, const uint32_t wa, const uint32_t wb) {
+		uint32_t out = 0;
+		for (int shift = 0; shift < 24; shift += 8) {
+			const uint32_t value = (((a >> shift) & 0xFFu) * wa + ((b >> shift) & 0xFFu) * wb) / (wa + wb);
+			out |= value << shift;
+		}
+		return out;
+	}
+
+	// BC1 colors, with the 3 color + black mode when c0 <= c1 unless the block is the color half of BC3.
+	static void DecodeColorBlock(const uint8_t* block, uint32_t (&texels)[16], const bool allowThreeColor) {
+		const uint16_t c0 = (uint16_t)(block[0] | (block[1] << 8));
+		const uint16_t c1 = (uint16_t)(block[2] | (block[3] << 8));
+		uint32_t palette[4];
+		palette[0] = Expand565(c0);
+		palette[1] = Expand565(c1);
+		if (c0 > c1 || !allowThreeColor) {
+			palette[2] = BlendRGB8(palette[0], palette[1], 2, 1);
+			palette[3] = BlendRGB8(palette[0], palette[1], 1, 2);
+		}
+		else {
+			palette[2] = BlendRGB8(palette[0], palette[1], 1, 1);
+			palette[3] = 0;
+		}
+
+		uint32_t indices;
+		memcpy(&indices, block + 4, sizeof(indices));
+		for (int i = 0; i < 16; i++)
+			texels[i] = palette[(indices >> (i * 2)) & 3];
+	}
+
+	// BC4 block, also the alpha half of BC3 and each half of BC5.
+	static void DecodeChannelBlock(const uint8_t* block, uint8_t (&values)[16]) {
+		const uint32_t a0 = block[0];
+		const uint32_t a1 = block[1];
+		uint8_t palette[8];
+		palette[0] = (uint8_t)a0;
+		palette[1] = (uint8_t)a1;
+		if (a0 > a1) {
+			for (uint32_t i = 1; i < 7; i++)
+				palette[i + 1] = (uint8_t)(((7 - i) * a0 + i * a1 + 3) / 7);
+		}
+		else {
+			for (uint32_t i = 1; i < 5; i++)
+				palette[i + 1] = (uint8_t)(((5 - i) * a0 + i * a1 + 2) / 5);
+			palette[6] = 0;
+			palette[7] = 255;
+		}
+
+		uint64_t indices = 0;
+		for (int i = 0; i < 6; i++)
+			indices |= (uint64_t)block[2 + i] << (i * 8);
+		for (int i = 0; i < 16; i++)
+			values[i] = palette[(indices >> (i * 3)) & 7];
+	}
+
+	void DecodeBlock(const TextureCompression compression, const uint8_t* block, uint32_t (&texels)[16]) {
+		uint8_t values[16];
+		switch (compression) {
+		case TextureCompression::BC1:
+			DecodeColorBlock(block, texels, true);
+			break;
+		case TextureCompression::BC3:
+			DecodeChannelBlock(block, values);
+			DecodeColorBlock(block + 8, texels, false);
+			for (int i = 0; i < 16; i++)
+				texels[i] |= (uint32_t)values[i] << 24;
+			break;
+		case TextureCompression::BC4:
+			DecodeChannelBlock(block, values);
+			for (int i = 0; i < 16; i++)
+				texels[i] = values[i];
+			break;
+		case TextureCompression::BC5:
+			DecodeChannelBlock(block, values);
+			for (int i = 0; i < 16; i++)
+				texels[i] = values[i];
+			DecodeChannelBlock(block + 8, values);
+			for (int i = 0; i < 16; i++)
+				texels[i] |= (uint32_t)values[i] << 8;
+			break;
+		default:
+			ASSERT(false);
+			break;
+		}
+	}
+
+	static uint32_t MakeFourCC(const char* code) {
+		return (uint32_t)code[0] | ((uint32_t)code[1] << 8) | ((uint32_t)code[2] << 16) | ((uint32_t)code[3] << 24);
+	}
+
+	static TextureCompression GetDXGICompression(const uint32_t dxgiFormat) {
+		switch (dxgiFormat) {
+		case 71: case 72:
+			return TextureCompression::BC1;
+		case 77: case 78:
+			return TextureCompression::BC3;
+		case 80: case 81:
+			return TextureCompression::BC4;
+		case 83: case 84:
+			return TextureCompression::BC5;
+		default:
+			return TextureCompression::NONE;
+		}
+	}
+
+	bool LoadDDS(const std::string& path, std::vector<uint8_t>& blocks, int& width, int& height, TextureCompression& compression) {
+		std::ifstream file(path, std::ios::binary);
+		if (!file)
+			return false;
+
+		// Magic plus the 124 byte DDS_HEADER, the pixel format FourCC sits at byte 84.
+		uint8_t header[128];
+		if (!file.read((char*)header, sizeof(header)) || memcmp(header, "DDS ", 4) != 0)
+			return false;
+
+		uint32_t fields[32];
+		memcpy(fields, header, sizeof(fields));
+		height = (int)fields[3];
+		width = (int)fields[4];
+		const uint32_t fourCC = fields[21];
+
+		compression = TextureCompression::NONE;
+		if (fourCC == MakeFourCC("DXT1"))
+			compression = TextureCompression::BC1;
+		else if (fourCC == MakeFourCC("DXT5"))
+			compression = TextureCompression::BC3;
+		else if (fourCC == MakeFourCC("ATI1") || fourCC == MakeFourCC("BC4U"))
+			compression = TextureCompression::BC4;
+		else if (fourCC == MakeFourCC("ATI2") || fourCC == MakeFourCC("BC5U"))
+			compression = TextureCompression::BC5;
+		else if (fourCC == MakeFourCC("DX10")) {
+			// DDS_HEADER_DXT10 follows, starting with the DXGI format.
+			uint32_t dx10[5];
+			if (!file.read((char*)dx10, sizeof(dx10)))
+				return false;
+			compression = GetDXGICompression(dx10[0]);
+		}
+		if (compression == TextureCompression::NONE || width <= 0 || height <= 0)
+			return false;
+
+		const int blocksX = (width + RTL_BLOCK_DIM - 1) / RTL_BLOCK_DIM;
+		const int blocksY = (height + RTL_BLOCK_DIM - 1) / RTL_BLOCK_DIM;
+		blocks.resize((size_t)blocksX * blocksY * GetBlockSize(compression));
+		return (bool)file.read((char*)blocks.data(), blocks.size());
+	}
+
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#define RTL_BLOCK_DIM 4
+
+namespace RTL {
+
+	// BC1 = RGB, BC3 = RGBA, BC4 = R, BC5 = RG, all in 4x4 texel blocks of 8 (BC1, BC4) or 16 bytes.
+	enum class TextureCompression {
+		NONE,
+		BC1,
+		BC3,
+		BC4,
+		BC5
+	};
+
+	int GetBlockSize(const TextureCompression compression);
+	int GetCompressionChannels(const TextureCompression compression);
+
+	// Compresses 8-bit pixels with top-down rows into blocks laid out row by row, edge blocks repeat the last texel.
+	// Channels the image lacks are compressed as 0, matching what Texture::Sample returns for them.
+	void CompressBlocks(const uint8_t* pixels, const int width, const int height, const int channels,
+						const TextureCompression compression, uint8_t* blocks);
+
+	// Decodes one block into 16 RGBA8 texels, channels the format does not store are 0.
+	void DecodeBlock(const TextureCompression compression, const uint8_t* block, uint32_t (&texels)[16]);
+
+	// Reads the top mip of a DDS file stored as DXT1, DXT5, ATI1/BC4 or ATI2/BC5.
+	bool LoadDDS(const std::string& path, std::vector<uint8_t>& blocks, int& width, int& height, TextureCompression& compression);
+
+}
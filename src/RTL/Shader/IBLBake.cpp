@@ -0,0 +1,308 @@
+#include "IBLBake.h"
+
+#include "RTL/Base/Parallel.h"
+#include "RTL/Shader/BRDFShader.h"
+
+#include <fstream>
+
+#define RTL_IBL_CACHE_MAGIC 0x4C424952u
+#define RTL_IBL_CACHE_VERSION 2u
+
+namespace RTL {
+
+	struct IBLCacheHeader {
+		uint32_t Magic;
+		uint32_t Version;
+		uint64_t Hash;
+		int32_t PrefilterWidth, PrefilterHeight;
+		int32_t PrefilterLevels;
+		int32_t BRDFSize;
+	};
+
+	struct EquirectLevel {
+		int Width, Height;
+		std::vector<Vec3> Data;
+	};
+
+	// Inverse of the equirect mapping in TextureSphere::Sample.
+	static Vec3 GetEquirectDirection(const int x, const int y, const int width, const int height) {
+		const float theta = (1.0f - (float)y / (height - 1)) * PI;
+		const float phi = ((float)x / (width - 1) - 0.5f) * 2.0f * PI;
+		return Vec3(sin(theta) * cos(phi), cos(theta), sin(theta) * sin(phi));
+	}
+
+	static Vec3 SampleEquirect(const EquirectLevel& level, const Vec3& dir) {
+		const float u = atan2(dir.Z, dir.X) / (2.0f * PI) + 0.5f;
+		const float v = 1.0f - acos(Clamp(dir.Y, -1.0f, 1.0f)) / PI;
+		const float fx = u * (level.Width - 1);
+		const float fy = v * (level.Height - 1);
+
+		const int x0 = std::min<int>((int)fx, level.Width - 1);
+		const int y0 = std::min<int>((int)fy, level.Height - 1);
+		const int x1 = (x0 + 1) % level.Width;
+		const int y1 = std::min<int>(y0 + 1, level.Height - 1);
+		const float dx = fx - x0;
+		const float dy = fy - y0;
+
+		const Vec3* row0 = level.Data.data() + y0 * level.Width;
+		const Vec3* row1 = level.Data.data() + y1 * level.Width;
+		const Vec3 c0 = row0[x0] * (1.0f - dx) + row0[x1] * dx;
+		const Vec3 c1 = row1[x0] * (1.0f - dx) + row1[x1] * dx;
+		return c0 * (1.0f - dy) + c1 * dy;
+	}
+
+	static uint64_t HashBytes(uint64_t hash, const void* data, const size_t size) {
+		const unsigned char* bytes = (const unsigned char*)data;
+		for (size_t i = 0; i < size; i++) {
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	uint64_t IBLBakedData::HashInput(const std::string& hdrPath, const IBLBakeSettings& settings) {
+		std::ifstream file(hdrPath, std::ios::binary);
+		if (!file)
+			return 0;
+
+		// FNV-1a over the file, then the settings and the cache version.
+		uint64_t hash = 14695981039346656037ull;
+		char buffer[1 << 16];
+		while (file) {
+			file.read(buffer, sizeof(buffer));
+			hash = HashBytes(hash, buffer, (size_t)file.gcount());
+		}
+
+		const uint32_t values[] = {
+			RTL_IBL_CACHE_VERSION, (uint32_t)settings.PrefilterWidth, (uint32_t)settings.PrefilterLevels, settings.PrefilterSamples,
+			(uint32_t)settings.BRDFSize, settings.BRDFSamples
+		};
+		hash = HashBytes(hash, values, sizeof(values));
+		return hash ? hash : 1;
+	}
+
+	IBLBakedData* IBLBakedData::Bake(const std::string& hdrPath, const IBLBakeSettings& settings) {
+		ASSERT(settings.PrefilterLevels > 1 && (settings.PrefilterWidth >> settings.PrefilterLevels) > 0 && settings.BRDFSize > 1);
+		const uint64_t hash = HashInput(hdrPath, settings);
+		if (!hash)
+			return nullptr;
+
+		stbi_set_flip_vertically_on_load(true);
+		int width, height, channels;
+		float* data = stbi_loadf(hdrPath.c_str(), &width, &height, &channels, 3);
+		if (!data)
+			return nullptr;
+
+		const int baseWidth = settings.PrefilterWidth;
+		const int baseHeight = baseWidth / 2;
+		float* base = stbir_resize_float_linear(data, width, height, 0,
+			nullptr, baseWidth, baseHeight, 0, stbir_pixel_layout::STBIR_RGB);
+		stbi_image_free(data);
+		if (!base)
+			return nullptr;
+
+		IBLBakedData* baked = new IBLBakedData();
+		baked->m_Hash = hash;
+		baked->BakePrefilter((const Vec3*)base, settings);
+
+		SHIrradiance irradiance((const Vec3*)base, baseWidth, baseHeight);
+		for (int i = 0; i < RTL_SH_COEFFICIENT_COUNT; i++)
+			baked->m_SH[i] = irradiance.GetCoefficients()[i];
+		stbi_image_free(base);
+
+		baked->BakeBRDFLUT(settings);
+		return baked;
+	}
+
+	void IBLBakedData::BakePrefilter(const Vec3* source, const IBLBakeSettings& settings) {
+		m_PrefilterWidth = settings.PrefilterWidth;
+		m_PrefilterHeight = settings.PrefilterWidth / 2;
+		m_PrefilterLevels = settings.PrefilterLevels;
+
+		// Box filtered mips of the source, sampled by the solid angle of each GGX sample to keep the result noise free.
+		std::vector<EquirectLevel> mips(1);
+		mips[0].Width = m_PrefilterWidth;
+		mips[0].Height = m_PrefilterHeight;
+		mips[0].Data.assign(source, source + m_PrefilterWidth * m_PrefilterHeight);
+		while (mips.back().Width > 1 && mips.back().Height > 1) {
+			const EquirectLevel& src = mips.back();
+			EquirectLevel dst;
+			dst.Width = src.Width / 2;
+			dst.Height = src.Height / 2;
+			dst.Data.resize(dst.Width * dst.Height);
+			for (int y = 0; y < dst.Height; y++) {
+				for (int x = 0; x < dst.Width; x++) {
+					const Vec3* row0 = src.Data.data() + (y * 2) * src.Width + x * 2;
+					const Vec3* row1 = row0 + src.Width;
+					dst.Data[y * dst.Width + x] = (row0[0] + row0[1] + row1[0] + row1[1]) * 0.25f;
+				}
+			}
+			mips.push_back(std::move(dst));
+		}
+		const float maxLod = (float)(mips.size() - 1);
+		const float texelSolidAngle = 4.0f * PI / (m_PrefilterWidth * m_PrefilterHeight);
+
+		size_t total = 0;
+		for (int level = 0; level < m_PrefilterLevels; level++)
+			total += (size_t)(m_PrefilterWidth >> level) * (m_PrefilterHeight >> level);
+		m_Prefilter.resize(total);
+
+		// Roughness 0 is the source itself.
+		std::copy(mips[0].Data.begin(), mips[0].Data.end(), m_Prefilter.begin());
+		Vec3* levelData = m_Prefilter.data() + mips[0].Data.size();
+
+		struct PrefilterSample {
+			Vec3 L;
+			float NdotL;
+			float Lod;
+		};
+
+		const uint32_t sampleCount = settings.PrefilterSamples;
+		for (int level = 1; level < m_PrefilterLevels; level++) {
+			const int width = m_PrefilterWidth >> level;
+			const int height = m_PrefilterHeight >> level;
+			const float roughness = (float)level / (m_PrefilterLevels - 1);
+
+			// With N = V = R the samples only differ per texel by the tangent frame, so they are generated once per level.
+			std::vector<PrefilterSample> samples;
+			samples.reserve(sampleCount);
+			const Vec3 up = Vec3(0.0f, 0.0f, 1.0f);
+			for (uint32_t i = 0; i < sampleCount; i++) {
+				const Vec3 H = ImportanceSampleGGX(Hammersley(i, sampleCount), up, roughness);
+				const Vec3 L = Normalize(2.0f * H.Z * H - up);
+				if (L.Z <= 0.0f)
+					continue;
+
+				const float a2 = roughness * roughness * roughness * roughness;
+				const float NdotH = Max(H.Z, 0.0f);
+				const float denom = NdotH * NdotH * (a2 - 1.0f) + 1.0f;
+				const float pdf = a2 / (PI * denom * denom) * 0.25f + 0.0001f;
+				const float sampleSolidAngle = 1.0f / (sampleCount * pdf);
+				const float lod = Clamp(0.5f * log2(sampleSolidAngle / texelSolidAngle) + 1.0f, 0.0f, maxLod);
+				samples.push_back({ L, L.Z, lod });
+			}
+
+			ParallelFor(0, height, [&](const int begin, const int end) {
+				for (int y = begin; y < end; y++) {
+					for (int x = 0; x < width; x++) {
+						const Vec3 N = GetEquirectDirection(x, y, width, height);
+						const Vec3 axis = abs(N.Z) < 0.999f ? Vec3(0.0f, 0.0f, 1.0f) : Vec3(1.0f, 0.0f, 0.0f);
+						const Vec3 tangent = Normalize(Cross(axis, N));
+						const Vec3 bitangent = Cross(N, tangent);
+
+						Vec3 sum = Vec3(0.0f);
+						float weight = 0.0f;
+						for (const PrefilterSample& sample : samples) {
+							const Vec3 L = tangent * sample.L.X + bitangent * sample.L.Y + N * sample.L.Z;
+							const int lod0 = (int)sample.Lod;
+							const int lod1 = std::min<int>(lod0 + 1, (int)maxLod);
+							const float t = sample.Lod - lod0;
+							const Vec3 color = SampleEquirect(mips[lod0], L) * (1.0f - t) + SampleEquirect(mips[lod1], L) * t;
+							sum += color * sample.NdotL;
+							weight += sample.NdotL;
+						}
+						levelData[y * width + x] = weight > 0.0f ? sum / weight : Vec3(0.0f);
+					}
+				}
+			});
+			levelData += width * height;
+		}
+	}
+
+	void IBLBakedData::BakeBRDFLUT(const IBLBakeSettings& settings) {
+		const int size = settings.BRDFSize;
+		m_BRDFSize = size;
+		m_BRDFLUT.resize(size * size);
+		ParallelFor(0, size, [&](const int begin, const int end) {
+			for (int y = begin; y < end; y++) {
+				const float roughness = (float)y / (size - 1);
+				for (int x = 0; x < size; x++) {
+					const float NdotV = Max((float)x / (size - 1), 0.001f);
+					m_BRDFLUT[y * size + x] = IntegrateBRDF(NdotV, roughness, settings.BRDFSamples);
+				}
+			}
+		});
+	}
+
+	bool IBLBakedData::SaveCache(const std::string& cachePath) const {
+		std::ofstream file(cachePath, std::ios::binary | std::ios::trunc);
+		if (!file)
+			return false;
+
+		IBLCacheHeader header = {
+			RTL_IBL_CACHE_MAGIC, RTL_IBL_CACHE_VERSION, m_Hash,
+			m_PrefilterWidth, m_PrefilterHeight, m_PrefilterLevels, m_BRDFSize
+		};
+		file.write((const char*)&header, sizeof(header));
+		file.write((const char*)m_SH, sizeof(m_SH));
+		file.write((const char*)m_Prefilter.data(), m_Prefilter.size() * sizeof(Vec3));
+		file.write((const char*)m_BRDFLUT.data(), m_BRDFLUT.size() * sizeof(Vec2));
+		return (bool)file;
+	}
+
+	// A hash of 0 accepts any cache, used when the source image is not shipped.
+	IBLBakedData* IBLBakedData::LoadCache(const std::string& cachePath, const uint64_t hash) {
+		std::ifstream file(cachePath, std::ios::binary);
+		if (!file)
+			return nullptr;
+
+		IBLCacheHeader header;
+		if (!file.read((char*)&header, sizeof(header)))
+			return nullptr;
+		if (header.Magic != RTL_IBL_CACHE_MAGIC || header.Version != RTL_IBL_CACHE_VERSION ||
+			(hash && header.Hash != hash) || header.PrefilterLevels < 1 || header.PrefilterLevels > 30 ||
+			(header.PrefilterWidth >> (header.PrefilterLevels - 1)) <= 0 ||
+			(header.PrefilterHeight >> (header.PrefilterLevels - 1)) <= 0 || header.BRDFSize <= 1)
+			return nullptr;
+
+		IBLBakedData* baked = new IBLBakedData();
+		baked->m_Hash = header.Hash;
+		baked->m_PrefilterWidth = header.PrefilterWidth;
+		baked->m_PrefilterHeight = header.PrefilterHeight;
+		baked->m_PrefilterLevels = header.PrefilterLevels;
+		baked->m_BRDFSize = header.BRDFSize;
+
+		size_t total = 0;
+		for (int level = 0; level < header.PrefilterLevels; level++)
+			total += (size_t)(header.PrefilterWidth >> level) * (header.PrefilterHeight >> level);
+		baked->m_Prefilter.resize(total);
+		baked->m_BRDFLUT.resize((size_t)header.BRDFSize * header.BRDFSize);
+
+		file.read((char*)baked->m_SH, sizeof(baked->m_SH));
+		file.read((char*)baked->m_Prefilter.data(), baked->m_Prefilter.size() * sizeof(Vec3));
+		file.read((char*)baked->m_BRDFLUT.data(), baked->m_BRDFLUT.size() * sizeof(Vec2));
+		if (!file) {
+			delete baked;
+			return nullptr;
+		}
+		return baked;
+	}
+
+	IBLBakedData* IBLBakedData::LoadOrBake(const std::string& hdrPath, const std::string& cachePath, const IBLBakeSettings& settings) {
+		const uint64_t hash = HashInput(hdrPath, settings);
+		IBLBakedData* baked = LoadCache(cachePath, hash);
+		if (baked || !hash)
+			return baked;
+
+		baked = Bake(hdrPath, settings);
+		if (baked)
+			baked->SaveCache(cachePath);
+		return baked;
+	}
+
+	LodTextureSphere* IBLBakedData::CreatePrefilterMap() const {
+		return new LodTextureSphere(m_Prefilter.data(), m_PrefilterWidth, m_PrefilterHeight, m_PrefilterLevels);
+	}
+
+	SHIrradiance* IBLBakedData::CreateIrradianceSH() const {
+		return new SHIrradiance(m_SH);
+	}
+
+	Texture* IBLBakedData::CreateBRDFLUT() const {
+		std::vector<Vec4> data(m_BRDFLUT.size());
+		for (size_t i = 0; i < data.size(); i++)
+			data[i] = Vec4(m_BRDFLUT[i], 0.0f, 0.0f);
+		return new Texture(m_BRDFSize, m_BRDFSize, data.data());
+	}
+
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include "RTL/Base/Maths.h"
+#include "RTL/Shader/Texture.h"
+#include "RTL/Shader/SphericalHarmonics.h"
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#define RTL_IBL_PREFILTER_LEVELS 5
+
+namespace RTL {
+
+	struct IBLBakeSettings {
+		int PrefilterWidth = 1024;
+		int PrefilterLevels = RTL_IBL_PREFILTER_LEVELS;
+		uint32_t PrefilterSamples = 256;
+		int BRDFSize = 128;
+		uint32_t BRDFSamples = 1024;
+	};
+
+	// Precomputed inputs of IBLPBRShader: GGX prefiltered specular levels (roughness level / (levels - 1)),
+	// SH9 irradiance and the split-sum BRDF LUT.
+	class IBLBakedData {
+	public:
+		static IBLBakedData* Bake(const std::string& hdrPath, const IBLBakeSettings& settings = IBLBakeSettings());
+		// Uses cachePath when it was baked from the same input and settings, otherwise bakes and rewrites it.
+		static IBLBakedData* LoadOrBake(const std::string& hdrPath, const std::string& cachePath, const IBLBakeSettings& settings = IBLBakeSettings());
+		static IBLBakedData* LoadCache(const std::string& cachePath, const uint64_t hash);
+		bool SaveCache(const std::string& cachePath) const;
+
+		// Hash of the input file contents and the settings, 0 if the file cannot be read.
+		static uint64_t HashInput(const std::string& hdrPath, const IBLBakeSettings& settings);
+
+		LodTextureSphere* CreatePrefilterMap() const;
+		SHIrradiance* CreateIrradianceSH() const;
+		Texture* CreateBRDFLUT() const;
+
+		uint64_t GetHash() const { return m_Hash; }
+
+	private:
+		IBLBakedData() = default;
+
+		void BakePrefilter(const Vec3* source, const IBLBakeSettings& settings);
+		void BakeBRDFLUT(const IBLBakeSettings& settings);
+
+	private:
+		uint64_t m_Hash = 0;
+
+		int m_PrefilterWidth = 0, m_PrefilterHeight = 0;
+		int m_PrefilterLevels = 0;
+		// All levels back to back, level i is (m_PrefilterWidth >> i) x (m_PrefilterHeight >> i).
+		std::vector<Vec3> m_Prefilter;
+		Vec3 m_SH[RTL_SH_COEFFICIENT_COUNT];
+
+		int m_BRDFSize = 0;
+		std::vector<Vec2> m_BRDFLUT;
+	};
+
+}
@@ -101,11 +101,12 @@ namespace RTL {
         Vec3 kD = 1.0f - kS;
         kD *= 1.0f - uniforms.Metallic;
 
-        Vec3 irradiance = uniforms.IrradianceMap->Sample(varyings.TexPos);
+        Vec3 irradiance = uniforms.IrradianceSH ? uniforms.IrradianceSH->Sample(varyings.TexPos) : uniforms.IrradianceMap->Sample(varyings.TexPos);
         Vec3 diffuse = irradiance * uniforms.Albedo;
 
-        constexpr float Max_REFLECTION_LOD = 4.0f;
-        Vec3 prefilteredColor = uniforms.PrefilterMap->Sample(R, roughness * 4.0f);
+        Vec3 prefilteredColor = uniforms.PrefilterCube ?
+            uniforms.PrefilterCube->Sample(R, roughness * (uniforms.PrefilterCube->GetLevelCount() - 1)) :
+            uniforms.PrefilterMap->Sample(R, roughness * (uniforms.PrefilterMap->GetLevelCount() - 1));
         Vec2 brdf = uniforms.BrdfLUT->Sample(Vec2(Max(NoV, 0.0f), roughness));
         Vec3 specular = prefilteredColor * (F * brdf.X + brdf.Y);
 
@@ -126,9 +127,14 @@ namespace RTL {
         uniforms.NormalMatrix = Mat4Identity();
     }
     void IBLPBRInit(IBLPBRUniforms& uniforms) {
-        uniforms.IrradianceMap = new TextureSphere("../../assets/Test.png");
-        uniforms.PrefilterMap = new LodTextureSphere("../../assets/test.png");
-        uniforms.BrdfLUT = new Texture("../../assets/box.png");
+        IBLBakedData* baked = IBLBakedData::LoadOrBake("../../assets/Test.png", "../../assets/Test.ibl");
+        ASSERT(baked);
+        uniforms.IrradianceSH = baked->CreateIrradianceSH();
+        LodTextureSphere* prefilter = baked->CreatePrefilterMap();
+        uniforms.PrefilterCube = new TextureCube(*prefilter, prefilter->GetWidth(0) / 4);
+        delete prefilter;
+        uniforms.BrdfLUT = baked->CreateBRDFLUT();
+        delete baked;
     }
 
 }
@@ -2,6 +2,8 @@
 #include "ShaderBase.h"
 
 #include "RTL/Shader/Texture.h"
+#include "RTL/Shader/SphericalHarmonics.h"
+#include "RTL/Shader/IBLBake.h"
 
 namespace RTL {
 
@@ -29,8 +31,12 @@ namespace RTL {
         Vec3 LightPos = Vec3(0.0f, 0.0f, -1.0f);
         Vec3 LightColor = Vec3(1.0f, 0.0f, 0.0f);
 
-        TextureSphere* IrradianceMap;
-        LodTextureSphere* PrefilterMap;
+        // Diffuse IBL uses IrradianceSH when set, IrradianceMap otherwise.
+        SHIrradiance* IrradianceSH = nullptr;
+        TextureSphere* IrradianceMap = nullptr;
+        // Specular IBL uses PrefilterCube when set, PrefilterMap otherwise.
+        TextureCube* PrefilterCube = nullptr;
+        LodTextureSphere* PrefilterMap = nullptr;
         Texture* BrdfLUT;
 	};
 
@@ -0,0 +1,107 @@
+#include "LightGrid.h"
+
+namespace RTL {
+
+	void LightGrid::Reset() {
+		m_TileCountX = m_TileCountY = 0;
+		m_Bounds.clear();
+		m_TileOffsets.clear();
+		m_LightIndices.clear();
+	}
+
+	void LightGrid::BuildTiles(const Mat4& viewProj, const int width, const int height) {
+		ASSERT(width > 0 && height > 0);
+		m_ViewProj = viewProj;
+		m_Width = width;
+		m_Height = height;
+		m_TileCountX = (width + RTL_LIGHT_TILE_SIZE - 1) / RTL_LIGHT_TILE_SIZE;
+		m_TileCountY = (height + RTL_LIGHT_TILE_SIZE - 1) / RTL_LIGHT_TILE_SIZE;
+
+		const size_t tileCount = (size_t)m_TileCountX * m_TileCountY;
+		const size_t lightCount = m_Bounds.size();
+
+		struct TileRect { int X0, Y0, X1, Y1; };
+		std::vector<TileRect> rects(lightCount);
+		std::vector<bool> visible(lightCount);
+		for (size_t i = 0; i < lightCount; i++) {
+			TileRect& rect = rects[i];
+			visible[i] = GetTileRect(m_Bounds[i], rect.X0, rect.Y0, rect.X1, rect.Y1);
+		}
+
+		// Two passes: count the lights of each tile, then scatter the indices into one flat array.
+		m_TileOffsets.assign(tileCount + 1, 0);
+		for (size_t i = 0; i < lightCount; i++) {
+			if (!visible[i]) continue;
+			const TileRect& rect = rects[i];
+			for (int y = rect.Y0; y <= rect.Y1; y++)
+				for (int x = rect.X0; x <= rect.X1; x++)
+					m_TileOffsets[(size_t)y * m_TileCountX + x + 1]++;
+		}
+		for (size_t i = 0; i < tileCount; i++)
+			m_TileOffsets[i + 1] += m_TileOffsets[i];
+
+		m_LightIndices.resize(m_TileOffsets[tileCount]);
+		std::vector<uint32_t> cursor(m_TileOffsets.begin(), m_TileOffsets.end() - 1);
+		for (size_t i = 0; i < lightCount; i++) {
+			if (!visible[i]) continue;
+			const TileRect& rect = rects[i];
+			for (int y = rect.Y0; y <= rect.Y1; y++)
+				for (int x = rect.X0; x <= rect.X1; x++)
+					m_LightIndices[cursor[(size_t)y * m_TileCountX + x]++] = (uint32_t)i;
+		}
+	}
+
+	// Screen-space bounds of the box around the light sphere, in tiles. Returns false if it is fully off screen.
+	bool LightGrid::GetTileRect(const LightBounds& bounds, int& x0, int& y0, int& x1, int& y1) const {
+		x0 = 0;
+		y0 = 0;
+		x1 = m_TileCountX - 1;
+		y1 = m_TileCountY - 1;
+		if (bounds.Radius <= 0.0f)
+			return true;
+
+		float minX = 1.0f, minY = 1.0f;
+		float maxX = -1.0f, maxY = -1.0f;
+		for (int i = 0; i < 8; i++) {
+			const Vec3 corner = bounds.Position + Vec3(
+				(i & 1) ? bounds.Radius : -bounds.Radius,
+				(i & 2) ? bounds.Radius : -bounds.Radius,
+				(i & 4) ? bounds.Radius : -bounds.Radius);
+			const Vec4 clipPos = m_ViewProj * Vec4(corner, 1.0f);
+			// A corner behind the camera makes the projection unbounded, keep the whole screen.
+			if (clipPos.W <= EPSILON)
+				return true;
+
+			const float ndcX = clipPos.X / clipPos.W;
+			const float ndcY = clipPos.Y / clipPos.W;
+			minX = Min(minX, ndcX);
+			minY = Min(minY, ndcY);
+			maxX = Max(maxX, ndcX);
+			maxY = Max(maxY, ndcY);
+		}
+
+		if (maxX < -1.0f || minX > 1.0f || maxY < -1.0f || minY > 1.0f)
+			return false;
+
+		const float tileScaleX = 0.5f * m_Width / RTL_LIGHT_TILE_SIZE;
+		const float tileScaleY = 0.5f * m_Height / RTL_LIGHT_TILE_SIZE;
+		x0 = std::max<int>(0, (int)((minX + 1.0f) * tileScaleX));
+		y0 = std::max<int>(0, (int)((minY + 1.0f) * tileScaleY));
+		x1 = std::min<int>(m_TileCountX - 1, (int)((maxX + 1.0f) * tileScaleX));
+		y1 = std::min<int>(m_TileCountY - 1, (int)((maxY + 1.0f) * tileScaleY));
+		return true;
+	}
+
+	int LightGrid::GetTileIndex(const Vec3& worldPos) const {
+		const Vec4 clipPos = m_ViewProj * Vec4(worldPos, 1.0f);
+		int x = 0, y = 0;
+		if (clipPos.W > EPSILON) {
+			x = (int)((clipPos.X / clipPos.W + 1.0f) * 0.5f * m_Width) / RTL_LIGHT_TILE_SIZE;
+			y = (int)((clipPos.Y / clipPos.W + 1.0f) * 0.5f * m_Height) / RTL_LIGHT_TILE_SIZE;
+		}
+		x = std::min<int>(std::max<int>(x, 0), m_TileCountX - 1);
+		y = std::min<int>(std::max<int>(y, 0), m_TileCountY - 1);
+		return y * m_TileCountX + x;
+	}
+
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "RTL/Base/Maths.h"
+
+#include <vector>
+#include <cstdint>
+
+#define RTL_LIGHT_TILE_SIZE 16
+
+namespace RTL {
+
+	// Smooth falloff to zero at the light radius, a radius of 0 means the light has unlimited range.
+	inline float GetLightRangeFactor(const float distance, const float radius) {
+		if (radius <= 0.0f) return 1.0f;
+		const float ratio = distance / radius;
+		const float window = Clamp(1.0f - ratio * ratio * ratio * ratio, 0.0f, 1.0f);
+		return window * window;
+	}
+
+	// Per screen tile light lists, rebuilt every frame from the light bounding spheres.
+	class LightGrid {
+	public:
+		template<typename light_t>
+		void Build(const std::vector<light_t>& lights, const Mat4& viewProj, const int width, const int height);
+		void Reset();
+
+		bool IsBuilt() const { return m_TileCountX > 0; }
+		int GetTileCountX() const { return m_TileCountX; }
+		int GetTileCountY() const { return m_TileCountY; }
+
+		// Calls func(lightIndex) for every light that can reach worldPos, or for all lights if the grid was not built.
+		template<typename func_t>
+		void ForEachLight(const Vec3& worldPos, const size_t lightCount, const func_t& func) const;
+
+	private:
+		struct LightBounds {
+			Vec3 Position;
+			float Radius;
+		};
+
+		void BuildTiles(const Mat4& viewProj, const int width, const int height);
+		bool GetTileRect(const LightBounds& bounds, int& x0, int& y0, int& x1, int& y1) const;
+		int GetTileIndex(const Vec3& worldPos) const;
+
+	private:
+		Mat4 m_ViewProj;
+		int m_Width = 0, m_Height = 0;
+		int m_TileCountX = 0, m_TileCountY = 0;
+
+		std::vector<LightBounds> m_Bounds;
+		// Lights of tile i are m_LightIndices[m_TileOffsets[i], m_TileOffsets[i + 1]).
+		std::vector<uint32_t> m_TileOffsets;
+		std::vector<uint32_t> m_LightIndices;
+	};
+
+	template<typename light_t>
+	void LightGrid::Build(const std::vector<light_t>& lights, const Mat4& viewProj, const int width, const int height) {
+		m_Bounds.resize(lights.size());
+		for (size_t i = 0; i < lights.size(); i++)
+			m_Bounds[i] = { lights[i].Position, lights[i].Radius };
+		BuildTiles(viewProj, width, height);
+	}
+
+	template<typename func_t>
+	void LightGrid::ForEachLight(const Vec3& worldPos, const size_t lightCount, const func_t& func) const {
+		if (!IsBuilt()) {
+			for (size_t i = 0; i < lightCount; i++)
+				func(i);
+			return;
+		}
+
+		const int tile = GetTileIndex(worldPos);
+		const uint32_t end = m_TileOffsets[tile + 1];
+		for (uint32_t i = m_TileOffsets[tile]; i < end; i++)
+			func((size_t)m_LightIndices[i]);
+	}
+
+}
@@ -52,28 +52,28 @@ namespace RTL {
 		return Vec3(x, y, z);
 	}
 
-	Vec4 PBRFragmentShader(bool& discard, const PBRVaryings& varyings, const PBRUniforms& uniforms) {
-		const Vec4 Albedo = uniforms.Albedo->Sample(varyings.TexCoord, uniforms.EnableLerpTexture, Vec4(1.0f, 1.0f, 1.0f, 1.0f));
-
-		const float Metallic = uniforms.Metallic->SampleFloat(varyings.TexCoord, uniforms.EnableLerpTexture, 0.7f);
-
-		const float Roughness = uniforms.Roughness->SampleFloat(varyings.TexCoord, uniforms.EnableLerpTexture, 0.5f);
-
-		const float Ao = uniforms.Ao->SampleFloat(varyings.TexCoord, uniforms.EnableLerpTexture, 1.0f);
+	static Vec3 ShadePBR(const PBRGBuffer& surface, const PBRUniforms& uniforms) {
+		const Vec3& Albedo = surface.Albedo;
+		const float Metallic = surface.Metallic;
+		const float Roughness = surface.Roughness;
 
-		Vec3 N = Normalize(varyings.WorldNormal);
-		Vec3 V = Normalize(uniforms.CameraPos - varyings.WorldPos);
+		Vec3 N = Normalize(surface.WorldNormal);
+		Vec3 V = Normalize(uniforms.CameraPos - surface.WorldPos);
 
 		Vec3 F0 = Vec3(0.04f, 0.04f, 0.04f);
 		F0 = Lerp(F0, Albedo, Metallic);
 
 		Vec3 Lo = Vec3(0.0f, 0.0f, 0.0f);
-		for (size_t i = 0; i < uniforms.Lights.size(); i++) {
-			Vec3 L = Normalize(uniforms.Lights[i].Position - varyings.WorldPos);
+		uniforms.LightTiles.ForEachLight(surface.WorldPos, uniforms.Lights.size(), [&](const size_t i) {
+			const PBRLight& light = uniforms.Lights[i];
+			float distance = Length(light.Position - surface.WorldPos);
+			float range = GetLightRangeFactor(distance, light.Radius);
+			if (range <= 0.0f)
+				return;
+
+			Vec3 L = Normalize(light.Position - surface.WorldPos);
 			Vec3 H = Normalize(L + V);
-			float distance = Length(uniforms.Lights[i].Position - varyings.WorldPos);
-			float attenuation = 1.0f / (distance * distance);
-			Vec3 radiance = uniforms.Lights[i].Color;
+			Vec3 radiance = light.Color * range;
 
 			float NDF = DistributionGGX(N, H, Roughness);
 			float G = GeometrySmith(N, V, L, Roughness);
@@ -90,18 +90,49 @@ namespace RTL {
 			float NdotL = Max(0.0f, Dot(N, L));
 
 			Lo += (kD * Albedo / PI + specular) * radiance * NdotL;
-		}
+		});
 
-		Vec3 ambient = Vec3(0.4f, 0.4f, 0.4f) * Albedo * Ao;
+		Vec3 ambient = Vec3(0.4f, 0.4f, 0.4f) * Albedo * surface.Ao;
 		Vec3 color = ambient + Lo;
-		color = color / (color + Vec3(1.0f));
-		
+		return color / (color + Vec3(1.0f));
+	}
+
+	void PBRGBufferShader(bool& discard, PBRGBuffer& gbuffer, const PBRVaryings& varyings, const PBRUniforms& uniforms) {
+		const Vec2& texCoord = varyings.TexCoord;
+		const bool lerp = uniforms.EnableLerpTexture;
+		gbuffer.Albedo = uniforms.Albedo ? (Vec3)uniforms.Albedo->Sample(texCoord, lerp) : Vec3(1.0f, 1.0f, 1.0f);
+		if (uniforms.ORM) {
+			Vec3 orm = uniforms.ORM->Sample(texCoord, lerp);
+			gbuffer.Ao = orm.X;
+			gbuffer.Roughness = orm.Y;
+			gbuffer.Metallic = orm.Z;
+		}
+		else {
+			gbuffer.Metallic = uniforms.Metallic ? uniforms.Metallic->SampleFloat(texCoord, lerp) : 0.7f;
+			gbuffer.Roughness = uniforms.Roughness ? uniforms.Roughness->SampleFloat(texCoord, lerp) : 0.5f;
+			gbuffer.Ao = uniforms.Ao ? uniforms.Ao->SampleFloat(texCoord, lerp) : 1.0f;
+		}
+		gbuffer.WorldNormal = varyings.WorldNormal;
+		gbuffer.WorldPos = varyings.WorldPos;
 		discard = false;
-		return Vec4(color, 1.0f);
+	}
+
+	Vec3 PBRLightingShader(const PBRGBuffer& gbuffer, const PBRUniforms& uniforms) {
+		return ShadePBR(gbuffer, uniforms);
+	}
+
+	Vec4 PBRFragmentShader(bool& discard, const PBRVaryings& varyings, const PBRUniforms& uniforms) {
+		PBRGBuffer surface;
+		PBRGBufferShader(discard, surface, varyings, uniforms);
+		return Vec4(ShadePBR(surface, uniforms), 1.0f);
 	}
 
 	void PBROnUpdate(PBRUniforms& uniforms) {
 		uniforms.ModelNormalWorld = Mat4Identity();
+		if (uniforms.EnableLightCulling)
+			uniforms.LightTiles.Build(uniforms.Lights, uniforms.ViewProj, uniforms.ViewportWidth, uniforms.ViewportHeight);
+		else
+			uniforms.LightTiles.Reset();
 		/*float Roughness = uniforms.Roughness->SampleFloat(Vec2(0.0f, 0.0f), false, 0.5f);
 		uniforms.Roughness = new Texture((fmod((Roughness + 0.01f), 1.0f)));*/
 	}
@@ -112,9 +143,7 @@ namespace RTL {
 		uniforms.Lights[0].Color = Vec3(1.0f, 1.0f, 1.0f);
 		uniforms.Lights[0].Position = Vec3(0.0f, 0.5f, -1.5f);
 		uniforms.Albedo = new Texture("Test.png");
-		uniforms.Roughness = new Texture("Test.png");
-		uniforms.Metallic = new Texture("Test.png");
-		uniforms.Ao = new Texture("Test.png");
+		uniforms.ORM = Texture::LoadORM("Test.png", "Test.png", "Test.png");
 	}
 
 }
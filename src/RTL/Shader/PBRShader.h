@@ -1,12 +1,14 @@
 #pragma once
 #include "ShaderBase.h"
 #include "RTL/Shader/Texture.h"
+#include "RTL/Shader/LightGrid.h"
 
 namespace RTL {
 
 	struct PBRLight {
 		Vec3 Position;
 		Vec3 Color;
+		float Radius = 0.0f;
 	};
 
 	struct PBRVertex : public VertexBase {
@@ -25,15 +27,34 @@ namespace RTL {
 		Texture* Metallic = nullptr;
 		Texture* Roughness = nullptr;
 		Texture* Ao = nullptr;
+		// Replaces Metallic, Roughness and Ao with a single fetch when set, see Texture::LoadORM.
+		Texture* ORM = nullptr;
 
 		bool EnableLerpTexture = true;
 
 		std::vector<PBRLight> Lights;
+
+		// Rebuilt by PBROnUpdate, fragments then only visit the lights of their screen tile.
+		bool EnableLightCulling = false;
+		LightGrid LightTiles;
+	};
+
+	// Deferred path: surface inputs of PBRFragmentShader, lit later once per pixel.
+	struct PBRGBuffer {
+		Vec3 Albedo;
+		Vec3 WorldNormal;
+		Vec3 WorldPos;
+		float Metallic;
+		float Roughness;
+		float Ao;
 	};
 
 	void PBRVertexShader(PBRVaryings& varyings, const PBRVertex& vertex, const PBRUniforms& uniforms);
     Vec4 PBRFragmentShader(bool& discard, const PBRVaryings& varyings, const PBRUniforms& uniforms);
 
+	void PBRGBufferShader(bool& discard, PBRGBuffer& gbuffer, const PBRVaryings& varyings, const PBRUniforms& uniforms);
+	Vec3 PBRLightingShader(const PBRGBuffer& gbuffer, const PBRUniforms& uniforms);
+
 	void PBROnUpdate(PBRUniforms& uniforms);
 	void PBRInit(PBRUniforms& uniforms);
 
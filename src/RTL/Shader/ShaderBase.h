@@ -20,6 +20,8 @@ namespace RTL {
 		Mat4 MVP;
 		Vec3 CameraPos;
 		Mat4 Model;
+		Mat4 ViewProj;
+		int ViewportWidth = 0, ViewportHeight = 0;
 	};
 
 }
@@ -0,0 +1,109 @@
+#include "SphericalHarmonics.h"
+
+#include "RTL/Base/Parallel.h"
+
+#include <array>
+
+namespace RTL {
+
+	static void EvaluateSHBasis(const Vec3& dir, float (&basis)[RTL_SH_COEFFICIENT_COUNT]) {
+		basis[0] = 0.282095f;
+		basis[1] = 0.488603f * dir.Y;
+		basis[2] = 0.488603f * dir.Z;
+		basis[3] = 0.488603f * dir.X;
+		basis[4] = 1.092548f * dir.X * dir.Y;
+		basis[5] = 1.092548f * dir.Y * dir.Z;
+		basis[6] = 0.315392f * (3.0f * dir.Z * dir.Z - 1.0f);
+		basis[7] = 1.092548f * dir.X * dir.Z;
+		basis[8] = 0.546274f * (dir.X * dir.X - dir.Y * dir.Y);
+	}
+
+	template<typename get_color_t>
+	void SHIrradiance::Project(const int width, const int height, const get_color_t& getColor) {
+		ASSERT(width > 1 && height > 1);
+
+		// Rows are projected in parallel into their own sums, then reduced in order so the result is deterministic.
+		using row_sum_t = std::array<Vec3, RTL_SH_COEFFICIENT_COUNT + 1>;
+		std::vector<row_sum_t> rowSums(height);
+		ParallelFor(0, height, [&](const int begin, const int end) {
+			float basis[RTL_SH_COEFFICIENT_COUNT];
+			for (int y = begin; y < end; y++) {
+				row_sum_t& sum = rowSums[y];
+				sum.fill(Vec3(0.0f));
+
+				// Inverse of the equirect mapping in TextureSphere::Sample.
+				const float theta = (1.0f - (float)y / (height - 1)) * PI;
+				const float sinTheta = sin(theta);
+				const float cosTheta = cos(theta);
+				const float weight = sinTheta * (2.0f * PI / width) * (PI / height);
+				for (int x = 0; x < width; x++) {
+					const float phi = ((float)x / (width - 1) - 0.5f) * 2.0f * PI;
+					const Vec3 dir = Vec3(sinTheta * cos(phi), cosTheta, sinTheta * sin(phi));
+					const Vec3 radiance = getColor(x, y) * weight;
+
+					EvaluateSHBasis(dir, basis);
+					for (int i = 0; i < RTL_SH_COEFFICIENT_COUNT; i++)
+						sum[i] += radiance * basis[i];
+					sum[RTL_SH_COEFFICIENT_COUNT].X += weight;
+				}
+			}
+		});
+
+		Vec3 coefficients[RTL_SH_COEFFICIENT_COUNT];
+		float totalWeight = 0.0f;
+		for (const row_sum_t& sum : rowSums) {
+			for (int i = 0; i < RTL_SH_COEFFICIENT_COUNT; i++)
+				coefficients[i] += sum[i];
+			totalWeight += sum[RTL_SH_COEFFICIENT_COUNT].X;
+		}
+
+		// Normalize the discrete solid angles to 4 PI, then convolve with the clamped cosine lobe
+		// (PI, 2 PI / 3, PI / 4 per band) and divide by PI to match an irradiance map.
+		const float normalize = 4.0f * PI / totalWeight;
+		constexpr float bandScale[RTL_SH_COEFFICIENT_COUNT] = {
+			1.0f,
+			2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f,
+			0.25f, 0.25f, 0.25f, 0.25f, 0.25f
+		};
+		for (int i = 0; i < RTL_SH_COEFFICIENT_COUNT; i++)
+			m_Coefficients[i] = coefficients[i] * (normalize * bandScale[i]);
+	}
+
+	SHIrradiance::SHIrradiance(const std::string& path) {
+		// The image is only needed while projecting.
+		TextureSphere texture(path);
+		Project(texture.GetWidth(), texture.GetHeight(), [&](const int x, const int y) {
+			return texture.GetColor(x, y);
+		});
+	}
+
+	SHIrradiance::SHIrradiance(const TextureSphere& texture) {
+		Project(texture.GetWidth(), texture.GetHeight(), [&](const int x, const int y) {
+			return texture.GetColor(x, y);
+		});
+	}
+
+	SHIrradiance::SHIrradiance(const Vec3* data, const int width, const int height) {
+		ASSERT(data);
+		Project(width, height, [&](const int x, const int y) {
+			return data[y * width + x];
+		});
+	}
+
+	SHIrradiance::SHIrradiance(const Vec3 (&coefficients)[RTL_SH_COEFFICIENT_COUNT]) {
+		for (int i = 0; i < RTL_SH_COEFFICIENT_COUNT; i++)
+			m_Coefficients[i] = coefficients[i];
+	}
+
+	Vec3 SHIrradiance::Sample(const Vec3& normal) const {
+		const Vec3 dir = Normalize(normal);
+		float basis[RTL_SH_COEFFICIENT_COUNT];
+		EvaluateSHBasis(dir, basis);
+
+		Vec3 result = Vec3(0.0f);
+		for (int i = 0; i < RTL_SH_COEFFICIENT_COUNT; i++)
+			result += m_Coefficients[i] * basis[i];
+		return Vec3(Max(result.X, 0.0f), Max(result.Y, 0.0f), Max(result.Z, 0.0f));
+	}
+
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include "RTL/Base/Maths.h"
+#include "RTL/Shader/Texture.h"
+
+#include <string>
+
+#define RTL_SH_COEFFICIENT_COUNT 9
+
+namespace RTL {
+
+	// Diffuse irradiance of an environment as 3 bands of spherical harmonics (SH9).
+	// Sample returns the same value a prefiltered irradiance map stores, irradiance / PI.
+	class SHIrradiance {
+	public:
+		SHIrradiance(const std::string& path);
+		SHIrradiance(const TextureSphere& texture);
+		SHIrradiance(const Vec3* data, const int width, const int height);
+		SHIrradiance(const Vec3 (&coefficients)[RTL_SH_COEFFICIENT_COUNT]);
+
+		Vec3 Sample(const Vec3& normal) const;
+
+		const Vec3* GetCoefficients() const { return m_Coefficients; }
+
+	private:
+		template<typename get_color_t>
+		void Project(const int width, const int height, const get_color_t& getColor);
+
+	private:
+		Vec3 m_Coefficients[RTL_SH_COEFFICIENT_COUNT];
+	};
+
+}
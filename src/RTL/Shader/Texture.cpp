@@ -1,10 +1,32 @@
 #include "Texture.h"
 
+#include "RTL/Base/Parallel.h"
+
+#include <atomic>
+#include <functional>
+
+#define RTL_VIRTUAL_PAGE_MAGIC 0x50545652u
+#define RTL_VIRTUAL_PAGE_VERSION 1u
+
 namespace RTL {
 
-	Texture::Texture(const std::string& path)
+	// HDR sphere textures are stored as RGB9E5, a third of the size of Vec3.
+	static void PackRGB9E5Pixels(const Vec3* src, uint32_t* dst, const int count) {
+		ParallelFor(0, count, [&](const int begin, const int end) {
+			for (int i = begin; i < end; i++)
+				dst[i] = PackRGB9E5(src[i]);
+		});
+	}
+
+	Texture::Texture(const std::string& path, const TextureUsage usage, const TextureCompression compression)
 		: m_Path(path) {
-		Init();
+		const bool isDDS = path.size() > 4 && path.compare(path.size() - 4, 4, ".dds") == 0;
+		if (usage == TextureUsage::SCALAR)
+			InitScalar();
+		else if (isDDS || compression != TextureCompression::NONE)
+			InitCompressed(compression);
+		else
+			Init();
 	}
 
 	Texture::Texture(const float value) {
@@ -13,6 +35,8 @@ namespace RTL {
 		m_Channels = 4;
 		m_Data = new Vec4[1];
 		m_Data[0] = Vec4(value, value, value, value);
+		m_IsConstant = true;
+		m_ConstantScalar = value;
 	}
 
 	Texture::Texture(const Vec4& value) {
@@ -21,12 +45,66 @@ namespace RTL {
 		m_Channels = 4;
 		m_Data = new Vec4[1];
 		m_Data[0] = value;
+		m_IsConstant = true;
+		m_ConstantScalar = (value.X + value.Y + value.Z + value.W) / 4.0f;
+	}
+
+	Texture::Texture(const int width, const int height, const Vec4* data) {
+		ASSERT(width > 0 && height > 0 && data);
+		m_Width = width;
+		m_Height = height;
+		m_Channels = 4;
+		m_Data = new Vec4[width * height];
+		memcpy(m_Data, data, width * height * sizeof(Vec4));
+	}
+
+	Texture::Texture(const int width, const int height, const uint32_t* texels, const int channels) {
+		ASSERT(width > 0 && height > 0 && texels && channels >= 1 && channels <= 4);
+		m_Width = width;
+		m_Height = height;
+		m_Channels = channels;
+		m_Texels = new uint32_t[width * height];
+		memcpy(m_Texels, texels, width * height * sizeof(uint32_t));
 	}
 
 	Texture::~Texture() {
 		if (m_Data)
 			delete[] m_Data;
 		m_Data = nullptr;
+		delete[] m_Texels;
+		m_Texels = nullptr;
+		delete[] m_Blocks;
+		m_Blocks = nullptr;
+		delete[] m_Scalar;
+		m_Scalar = nullptr;
+	}
+
+	void Texture::InitScalar() {
+		int width, height, channels;
+		stbi_set_flip_vertically_on_load(1);
+		stbi_uc* data = stbi_load(m_Path.c_str(), &width, &height, &channels, 0);
+		ASSERT(data);
+
+		m_Height = height;
+		m_Width = width;
+		m_Channels = 1;
+		int size = width * height;
+		m_Scalar = new uint16_t[size];
+
+		// Same channel average SampleFloat computes for color textures, scaled from 0..255 to 0..65535.
+		for (int i = 0; i < size; i++) {
+			int sum = 0;
+			for (int c = 0; c < channels; c++)
+				sum += data[i * channels + c];
+			m_Scalar[i] = (uint16_t)((sum * 257 + channels / 2) / channels);
+		}
+		stbi_image_free(data);
+	}
+
+	float Texture::SampleScalar(Vec2 texCoords, bool enableLerp) const {
+		if (enableLerp)
+			return SampleTexels<SamplerFilter::LINEAR, SamplerWrap::CLAMP, SamplerWrap::CLAMP, TexelFormat::R16>(*this, texCoords).X;
+		return SampleTexels<SamplerFilter::NEAREST, SamplerWrap::CLAMP, SamplerWrap::CLAMP, TexelFormat::R16>(*this, texCoords).X;
 	}
 
 	void Texture::Init() {
@@ -35,110 +113,249 @@ namespace RTL {
 		stbi_uc* data = nullptr;
 		data = stbi_load(m_Path.c_str(), &width, &height, &channels, 0);
 		ASSERT(data);
+		ASSERT(channels >= 1 && channels <= 4);
 
 		m_Height = height;
 		m_Width = width;
 		m_Channels = channels;
 		int size = width * height;
-		m_Data = new Vec4[size];
+		m_Texels = new uint32_t[size];
+
+		// Missing channels read as 0, as they did when texels were stored as Vec4.
+		for (int i = 0; i < size; i++) {
+			uint32_t texel = 0;
+			for (int c = 0; c < channels; c++)
+				texel |= (uint32_t)data[i * channels + c] << (c * 8);
+			m_Texels[i] = texel;
+		}
+		stbi_image_free(data);
+	}
 
-		switch (channels) {
-		case 4:
-			for (int i = 0; i < size; i++) {
-				m_Data[i] = Vec4(
-					UChar2Float(data[i * 4]),
-					UChar2Float(data[i * 4 + 1]),
-					UChar2Float(data[i * 4 + 2]),
-					UChar2Float(data[i * 4 + 3])
-				);
-			}
-			break;
+	void Texture::InitCompressed(const TextureCompression compression) {
+		std::vector<uint8_t> blocks;
+		int width = 0, height = 0;
+		if (LoadDDS(m_Path, blocks, width, height, m_Compression)) {
+			m_Channels = GetCompressionChannels(m_Compression);
+		}
+		else {
+			ASSERT(compression != TextureCompression::NONE);
+			// Not flipped, blocks keep the top-down rows DDS files use and FetchBlockTexel flips instead.
+			int channels;
+			stbi_set_flip_vertically_on_load(0);
+			stbi_uc* data = stbi_load(m_Path.c_str(), &width, &height, &channels, 0);
+			ASSERT(data);
+
+			m_Compression = compression;
+			m_Channels = std::min<int>(channels, GetCompressionChannels(compression));
+			const int blockCount = ((width + RTL_BLOCK_DIM - 1) / RTL_BLOCK_DIM) * ((height + RTL_BLOCK_DIM - 1) / RTL_BLOCK_DIM);
+			blocks.resize((size_t)blockCount * GetBlockSize(compression));
+			CompressBlocks(data, width, height, channels, compression, blocks.data());
+			stbi_image_free(data);
+		}
 
-		case 3:
-			for (int i = 0; i < size; i++) {
-				m_Data[i] = Vec4(
-					UChar2Float(data[i * 3]),
-					UChar2Float(data[i * 3 + 1]),
-					UChar2Float(data[i * 3 + 2]),
-					0.0f
-				);
-			}
-			break;
+		m_Width = width;
+		m_Height = height;
+		m_BlocksX = (width + RTL_BLOCK_DIM - 1) / RTL_BLOCK_DIM;
+		m_Blocks = new uint8_t[blocks.size()];
+		memcpy(m_Blocks, blocks.data(), blocks.size());
 
-		case 2:
-			for (int i = 0; i < size; i++) {
-				m_Data[i] = Vec4(
-					UChar2Float(data[i * 2]),
-					UChar2Float(data[i * 2 + 1]),
-					0.0f,
-					0.0f
-				);
-			}
-			break;
+		static std::atomic<uint32_t> nextBlockCacheKey(1);
+		m_BlockCacheKey = nextBlockCacheKey++;
+	}
 
-		case 1:
-			for (int i = 0; i < size; i++) {
-				m_Data[i] = Vec4(
-					UChar2Float(data[i]),
-					0.0f,
-					0.0f,
-					0.0f
-				);
-			}
-			break;
+	struct DecodedBlock {
+		uint32_t Key = 0;
+		int Index = -1;
+		uint32_t Texels[16];
+	};
+
+	static thread_local DecodedBlock s_BlockCache[RTL_BLOCK_CACHE_SIZE];
+
+	uint32_t Texture::FetchBlockTexel(const int x, const int y) const {
+		const int row = m_Height - 1 - y;
+		const int bx = x / RTL_BLOCK_DIM;
+		const int by = row / RTL_BLOCK_DIM;
+		const int blockIndex = bx + by * m_BlocksX;
+
+		// Any 8x8 group of blocks maps to distinct slots, so a bilinear footprint never evicts itself.
+		const int slot = ((bx & 7) | ((by & 7) << 3)) ^ (int)(m_BlockCacheKey & (RTL_BLOCK_CACHE_SIZE - 1));
+		DecodedBlock& entry = s_BlockCache[slot];
+		if (entry.Key != m_BlockCacheKey || entry.Index != blockIndex) {
+			DecodeBlock(m_Compression, m_Blocks + (size_t)blockIndex * GetBlockSize(m_Compression), entry.Texels);
+			entry.Key = m_BlockCacheKey;
+			entry.Index = blockIndex;
+		}
+		return entry.Texels[(x % RTL_BLOCK_DIM) + (row % RTL_BLOCK_DIM) * RTL_BLOCK_DIM];
+	}
 
-		default:
-            ASSERT(false);
-			break;
+	template<SamplerWrap wrap>
+	static int WrapTexel(int i, const int size) {
+		if (wrap == SamplerWrap::CLAMP)
+			return std::min<int>(std::max<int>(i, 0), size - 1);
+		if (wrap == SamplerWrap::REPEAT) {
+			i %= size;
+			return i < 0 ? i + size : i;
 		}
+		const int period = size * 2;
+		i %= period;
+		if (i < 0)
+			i += period;
+		return i < size ? i : period - 1 - i;
 	}
 
-	Vec4 Texture::Sample(Vec2 texCoords, bool enableLerp, Vec4 defaultValue) const {
-		if (this == nullptr)
-			return defaultValue;
-		if (m_Data == nullptr)
-			return defaultValue;
-		if (!enableLerp) {
-			float vx = Clamp(texCoords.X, 0.0f, 1.0f);
-			float vy = Clamp(texCoords.Y, 0.0f, 1.0f);
+	// Position in texel units where texel i covers [i, i + 1).
+	template<SamplerWrap wrap>
+	static float GetTexelPosition(const float t, const int size) {
+		if (wrap == SamplerWrap::CLAMP)
+			return Clamp(t, 0.0f, 1.0f) * (size - 1) + 0.5f;
+		return t * size;
+	}
 
-			int x = (int)(vx * (m_Width - 1) + 0.5f);
-			int y = (int)(vy * (m_Height - 1) + 0.5f);
+	static Vec4 UnpackRGBA8(const uint32_t texel) {
+		constexpr float scale = 1.0f / 255.0f;
+		return Vec4(
+			(float)(texel & 0xFFu) * scale,
+			(float)((texel >> 8) & 0xFFu) * scale,
+			(float)((texel >> 16) & 0xFFu) * scale,
+			(float)(texel >> 24) * scale);
+	}
 
-			int index = x + y * m_Width;
-			return m_Data[index];
+	// a + (b - a) * weight / 256 on all four bytes at once, R/B and G/A in separate 16-bit lanes.
+	static uint32_t LerpRGBA8(const uint32_t a, const uint32_t b, const uint32_t weight) {
+		const uint32_t rb = ((a & 0x00FF00FFu) * (256 - weight) + (b & 0x00FF00FFu) * weight + 0x00800080u) >> 8;
+		const uint32_t ga = ((a >> 8) & 0x00FF00FFu) * (256 - weight) + ((b >> 8) & 0x00FF00FFu) * weight + 0x00800080u;
+		return (rb & 0x00FF00FFu) | (ga & 0xFF00FF00u);
+	}
+
+	template<SamplerFilter filter, SamplerWrap wrapU, SamplerWrap wrapV, Texture::TexelFormat format>
+	Vec4 Texture::SampleTexels(const Texture& texture, const Vec2& texCoords) {
+		constexpr float scalarScale = 1.0f / 65535.0f;
+		const int width = texture.m_Width;
+		const int height = texture.m_Height;
+		const float px = GetTexelPosition<wrapU>(texCoords.X, width);
+		const float py = GetTexelPosition<wrapV>(texCoords.Y, height);
+
+		if (filter == SamplerFilter::NEAREST) {
+			const int x = WrapTexel<wrapU>((int)std::floor(px), width);
+			const int y = WrapTexel<wrapV>((int)std::floor(py), height);
+			const int index = x + y * width;
+			if (format == TexelFormat::RGBA8 || format == TexelFormat::BLOCK)
+				return UnpackRGBA8(texture.FetchRGBA8<format>(x, y));
+			if (format == TexelFormat::R16) {
+				const float value = texture.m_Scalar[index] * scalarScale;
+				return Vec4(value, value, value, value);
+			}
+			return texture.m_Data[index];
 		}
-		else {
-			float vx = Clamp(texCoords.X, 0.0f, 1.0f);
-			float vy = Clamp(texCoords.Y, 0.0f, 1.0f);
 
-			float fx = vx * (m_Width - 1);
-			float fy = vy * (m_Height - 1);
+		const float fx = px - 0.5f;
+		const float fy = py - 0.5f;
+		const float floorX = std::floor(fx);
+		const float floorY = std::floor(fy);
+		const int x0 = WrapTexel<wrapU>((int)floorX, width);
+		const int x1 = WrapTexel<wrapU>((int)floorX + 1, width);
+		const int y0 = WrapTexel<wrapV>((int)floorY, height);
+		const int y1 = WrapTexel<wrapV>((int)floorY + 1, height);
+		const int row0 = y0 * width;
+		const int row1 = y1 * width;
+		const float dx = fx - floorX;
+		const float dy = fy - floorY;
+
+		if (format == TexelFormat::RGBA8 || format == TexelFormat::BLOCK) {
+			const uint32_t wx = (uint32_t)(dx * 256.0f + 0.5f);
+			const uint32_t wy = (uint32_t)(dy * 256.0f + 0.5f);
+			const uint32_t c0 = LerpRGBA8(texture.FetchRGBA8<format>(x0, y0), texture.FetchRGBA8<format>(x1, y0), wx);
+			const uint32_t c1 = LerpRGBA8(texture.FetchRGBA8<format>(x0, y1), texture.FetchRGBA8<format>(x1, y1), wx);
+			return UnpackRGBA8(LerpRGBA8(c0, c1, wy));
+		}
 
-			int x0 = (int)fx;
-			int y0 = (int)fy;
-			int x1 = (int)Clamp((float)x0 + 1.0f, 0.0f, (float)m_Width - 1.0f);
-			int y1 = (int)Clamp((float)y0 + 1.0f, 0.0f, (float)m_Height - 1.0f);
+		if (format == TexelFormat::R16) {
+			const uint16_t* scalar = texture.m_Scalar;
+			const float c0 = scalar[row0 + x0] + (scalar[row0 + x1] - scalar[row0 + x0]) * dx;
+			const float c1 = scalar[row1 + x0] + (scalar[row1 + x1] - scalar[row1 + x0]) * dx;
+			const float value = (c0 + (c1 - c0) * dy) * scalarScale;
+			return Vec4(value, value, value, value);
+		}
 
-			float dx = fx - x0;
-			float dy = fy - y0;
+		const Vec4* data = texture.m_Data;
+		Vec4 c0 = data[row0 + x0] * (1 - dx) + data[row0 + x1] * dx;
+		Vec4 c1 = data[row1 + x0] * (1 - dx) + data[row1 + x1] * dx;
+		return c0 * (1 - dy) + c1 * dy;
+	}
 
-			Vec4 c00 = m_Data[x0 + y0 * m_Width];
-			Vec4 c10 = m_Data[x1 + y0 * m_Width];
-			Vec4 c01 = m_Data[x0 + y1 * m_Width];
-			Vec4 c11 = m_Data[x1 + y1 * m_Width];
+	template<SamplerFilter filter, Texture::TexelFormat format>
+	SampledTexture::sample_func_t Texture::SelectSampleFunc(const SamplerWrap wrapU, const SamplerWrap wrapV) {
+		static const SampledTexture::sample_func_t funcs[3][3] = {
+			{
+				&SampleTexels<filter, SamplerWrap::CLAMP, SamplerWrap::CLAMP, format>,
+				&SampleTexels<filter, SamplerWrap::CLAMP, SamplerWrap::REPEAT, format>,
+				&SampleTexels<filter, SamplerWrap::CLAMP, SamplerWrap::MIRROR, format>
+			},
+			{
+				&SampleTexels<filter, SamplerWrap::REPEAT, SamplerWrap::CLAMP, format>,
+				&SampleTexels<filter, SamplerWrap::REPEAT, SamplerWrap::REPEAT, format>,
+				&SampleTexels<filter, SamplerWrap::REPEAT, SamplerWrap::MIRROR, format>
+			},
+			{
+				&SampleTexels<filter, SamplerWrap::MIRROR, SamplerWrap::CLAMP, format>,
+				&SampleTexels<filter, SamplerWrap::MIRROR, SamplerWrap::REPEAT, format>,
+				&SampleTexels<filter, SamplerWrap::MIRROR, SamplerWrap::MIRROR, format>
+			}
+		};
+		return funcs[(int)wrapU][(int)wrapV];
+	}
 
-			Vec4 c0 = c00 * (1 - dx) + c10 * dx;
-			Vec4 c1 = c01 * (1 - dx) + c11 * dx;
-			Vec4 c = c0 * (1 - dy) + c1 * dy;
+	SampledTexture Texture::Bind(const Sampler& sampler) const {
+		SampledTexture sampled;
+		sampled.m_Texture = this;
+
+		const bool linear = sampler.Filter == SamplerFilter::LINEAR;
+		if (m_IsConstant)
+			sampled.m_Sample = &SampleConstant;
+		else if (m_Texels)
+			sampled.m_Sample = linear ? SelectSampleFunc<SamplerFilter::LINEAR, TexelFormat::RGBA8>(sampler.WrapU, sampler.WrapV)
+				: SelectSampleFunc<SamplerFilter::NEAREST, TexelFormat::RGBA8>(sampler.WrapU, sampler.WrapV);
+		else if (m_Blocks)
+			sampled.m_Sample = linear ? SelectSampleFunc<SamplerFilter::LINEAR, TexelFormat::BLOCK>(sampler.WrapU, sampler.WrapV)
+				: SelectSampleFunc<SamplerFilter::NEAREST, TexelFormat::BLOCK>(sampler.WrapU, sampler.WrapV);
+		else if (m_Scalar)
+			sampled.m_Sample = linear ? SelectSampleFunc<SamplerFilter::LINEAR, TexelFormat::R16>(sampler.WrapU, sampler.WrapV)
+				: SelectSampleFunc<SamplerFilter::NEAREST, TexelFormat::R16>(sampler.WrapU, sampler.WrapV);
+		else
+			sampled.m_Sample = linear ? SelectSampleFunc<SamplerFilter::LINEAR, TexelFormat::FLOAT4>(sampler.WrapU, sampler.WrapV)
+				: SelectSampleFunc<SamplerFilter::NEAREST, TexelFormat::FLOAT4>(sampler.WrapU, sampler.WrapV);
+		return sampled;
+	}
 
-			return c;
+	Vec4 Texture::Sample(Vec2 texCoords, bool enableLerp, Vec4 defaultValue) const {
+		if (m_IsConstant)
+			return m_Data[0];
+		if (m_Texels) {
+			if (enableLerp)
+				return SampleTexels<SamplerFilter::LINEAR, SamplerWrap::CLAMP, SamplerWrap::CLAMP, TexelFormat::RGBA8>(*this, texCoords);
+			return SampleTexels<SamplerFilter::NEAREST, SamplerWrap::CLAMP, SamplerWrap::CLAMP, TexelFormat::RGBA8>(*this, texCoords);
+		}
+		if (m_Blocks) {
+			if (enableLerp)
+				return SampleTexels<SamplerFilter::LINEAR, SamplerWrap::CLAMP, SamplerWrap::CLAMP, TexelFormat::BLOCK>(*this, texCoords);
+			return SampleTexels<SamplerFilter::NEAREST, SamplerWrap::CLAMP, SamplerWrap::CLAMP, TexelFormat::BLOCK>(*this, texCoords);
+		}
+		if (m_Scalar) {
+			float value = SampleScalar(texCoords, enableLerp);
+			return Vec4(value, value, value, value);
 		}
+		if (m_Data == nullptr)
+			return defaultValue;
+		if (enableLerp)
+			return SampleTexels<SamplerFilter::LINEAR, SamplerWrap::CLAMP, SamplerWrap::CLAMP, TexelFormat::FLOAT4>(*this, texCoords);
+		return SampleTexels<SamplerFilter::NEAREST, SamplerWrap::CLAMP, SamplerWrap::CLAMP, TexelFormat::FLOAT4>(*this, texCoords);
 	}
 
 	float Texture::SampleFloat(Vec2 texCoords, bool enableLerp, float defaultValue) const {
-		if (this == nullptr)
-			return defaultValue;
+		if (m_IsConstant)
+			return m_ConstantScalar;
+		if (m_Scalar)
+			return SampleScalar(texCoords, enableLerp);
 		Vec4 c;
 		switch (m_Channels) {
 		case 1:
@@ -158,6 +375,191 @@ namespace RTL {
 	}
 
 
+	TextureAtlas::TextureAtlas(const int pageSize, const int padding)
+		: m_PageSize(pageSize), m_Padding(padding) {
+		ASSERT(pageSize > 1 && padding >= 1);
+	}
+
+	int TextureAtlas::Add(const std::string& path) {
+		int width, height, channels;
+		stbi_set_flip_vertically_on_load(1);
+		stbi_uc* data = stbi_load(path.c_str(), &width, &height, &channels, 0);
+		ASSERT(data);
+		if (!data) {
+			m_Regions.emplace_back();
+			return (int)m_Regions.size() - 1;
+		}
+		const int region = Add(width, height, channels, data);
+		stbi_image_free(data);
+		return region;
+	}
+
+	int TextureAtlas::Add(const int width, const int height, const int channels, const uint8_t* pixels) {
+		ASSERT(width > 0 && height > 0 && channels >= 1 && channels <= 4 && pixels);
+		const int region = (int)m_Regions.size();
+		PendingImage image;
+		image.Region = region;
+		image.Width = width;
+		image.Height = height;
+		image.Channels = channels;
+		image.Pixels.assign(pixels, pixels + (size_t)width * height * channels);
+		m_Pending.push_back(std::move(image));
+		m_Regions.emplace_back();
+		return region;
+	}
+
+	// Writes the image at (x, y) of its padded rectangle, padding repeats the nearest edge texel.
+	void TextureAtlas::Place(const PendingImage& image, const int x, const int y, uint32_t* texels) const {
+		const int paddedWidth = image.Width + m_Padding * 2;
+		const int paddedHeight = image.Height + m_Padding * 2;
+		for (int j = 0; j < paddedHeight; j++) {
+			const int srcY = std::min<int>(std::max<int>(j - m_Padding, 0), image.Height - 1);
+			uint32_t* dst = texels + (size_t)(y + j) * m_PageSize + x;
+			for (int i = 0; i < paddedWidth; i++) {
+				const int srcX = std::min<int>(std::max<int>(i - m_Padding, 0), image.Width - 1);
+				const uint8_t* src = image.Pixels.data() + ((size_t)srcX + (size_t)srcY * image.Width) * image.Channels;
+				uint32_t texel = 0;
+				for (int c = 0; c < image.Channels; c++)
+					texel |= (uint32_t)src[c] << (c * 8);
+				dst[i] = texel;
+			}
+		}
+	}
+
+	void TextureAtlas::Build() {
+		std::vector<stbrp_rect> remaining;
+		for (size_t i = 0; i < m_Pending.size(); i++) {
+			const PendingImage& image = m_Pending[i];
+			stbrp_rect rect = {};
+			rect.id = (int)i;
+			rect.w = image.Width + m_Padding * 2;
+			rect.h = image.Height + m_Padding * 2;
+			ASSERT(rect.w <= m_PageSize && rect.h <= m_PageSize);
+			if (rect.w <= m_PageSize && rect.h <= m_PageSize)
+				remaining.push_back(rect);
+		}
+
+		// Every pass packs as much as fits into a fresh page and leaves the rest for the next one.
+		// Later Build calls only add pages for images queued since the last one.
+		const float pageScale = 1.0f / (m_PageSize - 1);
+		std::vector<stbrp_node> nodes(m_PageSize);
+		std::vector<uint32_t> texels;
+		while (!remaining.empty()) {
+			stbrp_context context;
+			stbrp_init_target(&context, m_PageSize, m_PageSize, nodes.data(), (int)nodes.size());
+			stbrp_pack_rects(&context, remaining.data(), (int)remaining.size());
+
+			const int page = (int)m_Pages.size();
+			texels.assign((size_t)m_PageSize * m_PageSize, 0);
+			std::vector<stbrp_rect> next;
+			for (const stbrp_rect& rect : remaining) {
+				if (!rect.was_packed) {
+					next.push_back(rect);
+					continue;
+				}
+				const PendingImage& image = m_Pending[rect.id];
+				Place(image, rect.x, rect.y, texels.data());
+
+				// Same edge-to-edge mapping Texture::Sample uses, so u = 0 and u = 1 land on the first and last texel.
+				AtlasRegion& region = m_Regions[image.Region];
+				region.Page = page;
+				region.Channels = image.Channels;
+				region.Offset = Vec2((rect.x + m_Padding) * pageScale, (rect.y + m_Padding) * pageScale);
+				region.Scale = Vec2((image.Width - 1) * pageScale, (image.Height - 1) * pageScale);
+			}
+			m_Pages.emplace_back(new Texture(m_PageSize, m_PageSize, texels.data()));
+			remaining.swap(next);
+		}
+		m_Pending.clear();
+	}
+
+	Vec2 TextureAtlas::TransformTexCoords(const int region, const Vec2& texCoords) const {
+		const AtlasRegion& data = m_Regions[region];
+		return Vec2(data.Offset.X + texCoords.X * data.Scale.X, data.Offset.Y + texCoords.Y * data.Scale.Y);
+	}
+
+	Vec4 TextureAtlas::Sample(const int region, Vec2 texCoords, bool enableLerp) const {
+		const AtlasRegion& data = m_Regions[region];
+		if (data.Page < 0)
+			return Vec4(0.0f);
+		texCoords.X = Clamp(texCoords.X, 0.0f, 1.0f);
+		texCoords.Y = Clamp(texCoords.Y, 0.0f, 1.0f);
+		return m_Pages[data.Page]->Sample(TransformTexCoords(region, texCoords), enableLerp);
+	}
+
+	float TextureAtlas::SampleFloat(const int region, Vec2 texCoords, bool enableLerp) const {
+		const Vec4 c = Sample(region, texCoords, enableLerp);
+		switch (m_Regions[region].Channels) {
+		case 1:
+			return c.X;
+		case 2:
+			return (c.X + c.Y) / 2.0f;
+		case 3:
+			return (c.X + c.Y + c.Z) / 3.0f;
+		case 4:
+			return (c.X + c.Y + c.Z + c.W) / 4.0f;
+		default:
+			return 0.0f;
+		}
+	}
+
+	// Loads one ORM component as the per-texel channel average, resized to width x height unless they are still 0.
+	static std::vector<unsigned char> LoadORMChannel(const std::string& path, int& width, int& height) {
+		std::vector<unsigned char> plane;
+		int srcWidth, srcHeight, channels;
+		stbi_set_flip_vertically_on_load(1);
+		stbi_uc* data = stbi_load(path.c_str(), &srcWidth, &srcHeight, &channels, 0);
+		ASSERT(data);
+		if (!data)
+			return plane;
+
+		plane.resize(srcWidth * srcHeight);
+		for (int i = 0; i < srcWidth * srcHeight; i++) {
+			int sum = 0;
+			for (int c = 0; c < channels; c++)
+				sum += data[i * channels + c];
+			plane[i] = (unsigned char)((sum + channels / 2) / channels);
+		}
+		stbi_image_free(data);
+
+		if (width == 0) {
+			width = srcWidth;
+			height = srcHeight;
+		}
+		else if (srcWidth != width || srcHeight != height) {
+			std::vector<unsigned char> resized(width * height);
+			stbir_resize_uint8_linear(plane.data(), srcWidth, srcHeight, 0,
+				resized.data(), width, height, 0, stbir_pixel_layout::STBIR_1CHANNEL);
+			plane.swap(resized);
+		}
+		return plane;
+	}
+
+	Texture* Texture::LoadORM(const std::string& aoPath, const std::string& roughnessPath, const std::string& metallicPath,
+							  const Vec3& defaultValue) {
+		int width = 0, height = 0;
+		const std::string* paths[3] = { &aoPath, &roughnessPath, &metallicPath };
+		std::vector<unsigned char> planes[3];
+		for (int i = 0; i < 3; i++) {
+			if (!paths[i]->empty())
+				planes[i] = LoadORMChannel(*paths[i], width, height);
+		}
+		if (width == 0)
+			return new Texture(Vec4(defaultValue, 0.0f));
+
+		const unsigned char defaults[3] = {
+			Float2UChar(defaultValue.X), Float2UChar(defaultValue.Y), Float2UChar(defaultValue.Z)
+		};
+		std::vector<uint32_t> texels(width * height);
+		for (size_t i = 0; i < texels.size(); i++) {
+			uint32_t texel = 0;
+			for (int c = 0; c < 3; c++)
+				texel |= (uint32_t)(planes[c].empty() ? defaults[c] : planes[c][i]) << (c * 8);
+			texels[i] = texel;
+		}
+		return new Texture(width, height, texels.data(), 3);
+	}
+
 	Vec3 TextureSphere::Sample(const Vec3& v3) const {
 		Vec3 dir = Normalize(v3);
 		float phi = atan2(dir.Z, dir.X);
@@ -169,7 +571,7 @@ namespace RTL {
 		int y = (int)(v * (m_Height - 1) + 0.5f);
 
 		int index = x + y * m_Width;
-		return m_Data[index];
+		return UnpackRGB9E5(m_Data[index]);
 	}
 
 	TextureSphere::TextureSphere(const std::string& path)
@@ -186,8 +588,8 @@ namespace RTL {
 		m_PixelSize = height * width;
 
 		int size = height * width;
-		m_Data = new Vec3[size];
-		memcpy(m_Data, data, size * sizeof(Vec3));
+		m_Data = new uint32_t[size];
+		PackRGB9E5Pixels((const Vec3*)data, m_Data, size);
 		stbi_image_free(data);
 	}
 
@@ -197,8 +599,12 @@ namespace RTL {
 		m_Channels = 3;
 		int size = m_Width * m_Height;
 		m_PixelSize = size;
-		m_Data = new Vec3[size];
-		memcpy(m_Data, framebuffer.GetRawColorData(), size * sizeof(Vec3));
+		m_Data = new uint32_t[size];
+		std::vector<Vec3> row(m_Width);
+		for (int y = 0; y < m_Height; y++) {
+			framebuffer.ReadColorRow(y, row.data());
+			PackRGB9E5Pixels(row.data(), m_Data + y * m_Width, m_Width);
+		}
 	}
 
 	TextureSphere::~TextureSphere() {
@@ -222,32 +628,31 @@ namespace RTL {
 		res->m_PixelSize = height * width;
 
 		int size = height * width;
-		res->m_Data = new Vec3[size];
-		memcpy(res->m_Data, data, size * sizeof(Vec3));
+		res->m_Data = new uint32_t[size];
+		PackRGB9E5Pixels((const Vec3*)data, res->m_Data, size);
 		stbi_image_free(data);
 		return res;
 	}
 
 	LodTextureSphere::LodTextureSphere(std::vector<std::string> paths) {
-		ASSERT(paths.size() == 5);
+		ASSERT(!paths.empty());
 
 		stbi_set_flip_vertically_on_load(true);
-		int width, height, channels, size;
-		float* data;
-		for (int i = 0; i < 5; i++) {
-			data = stbi_loadf(paths[i].c_str(), &width, &height, &channels, 0);
-			ASSERT((data) && (width > 0) && (height > 0) && (channels == 3));
-			size = height * width;
-
-			m_Data[i].Height = height;
-			m_Data[i].Width = width;
-			m_Data[i].Channels = channels;
-			m_Data[i].PixelSize = size;
-			m_Data[i].ColorData = new Vec3[size];
-			memcpy(m_Data[i].ColorData, data, size * sizeof(Vec3));
-
+		std::vector<std::vector<uint32_t>> levels(paths.size());
+		for (size_t i = 0; i < paths.size(); i++) {
+			int width, height, channels;
+			float* data = stbi_loadf(paths[i].c_str(), &width, &height, &channels, 3);
+			ASSERT((data) && (width > 0) && (height > 0));
+
+			AddLevel(width, height);
+			levels[i].resize(width * height);
+			PackRGB9E5Pixels((const Vec3*)data, levels[i].data(), width * height);
 			stbi_image_free(data);
 		}
+
+		Allocate();
+		for (size_t i = 0; i < levels.size(); i++)
+			std::copy(levels[i].begin(), levels[i].end(), m_Data + m_Levels[i].Offset);
 	}
 
 	LodTextureSphere::LodTextureSphere(std::string path) {
@@ -255,157 +660,597 @@ namespace RTL {
 		int in_width, in_height, in_channels;
 		float* in_data;
 
-		in_data = stbi_loadf(path.c_str(), &in_width, &in_height, &in_channels, 0);
-		ASSERT(((in_data) && (in_width >= 32 * 2) && (in_height >= 32) && (in_channels == 3)));
+		in_data = stbi_loadf(path.c_str(), &in_width, &in_height, &in_channels, 3);
+		ASSERT(((in_data) && (in_width >= RTL_LOD_SPHERE_MIN_HEIGHT * 2) && (in_height >= RTL_LOD_SPHERE_MIN_HEIGHT)));
 
-		int width = 2048;
-		int height = width / 2;
+		int width = RTL_LOD_SPHERE_MIN_HEIGHT * 2;
+		while (width * 2 <= in_width)
+			width *= 2;
+		for (int levelWidth = width; levelWidth / 2 >= RTL_LOD_SPHERE_MIN_HEIGHT; levelWidth /= 2)
+			AddLevel(levelWidth, levelWidth / 2);
+		Allocate();
 
-		for (int i = 0; i < 5; ++i) {
+		for (const Level& level : m_Levels) {
 			float* data = stbir_resize_float_linear(in_data, in_width, in_height, 0,
-				nullptr, width, height, 0, stbir_pixel_layout::STBIR_RGB);
-			int size = width * height;
-			m_Data[i].ColorData = new Vec3[size];
-			m_Data[i].Height = height;
-			m_Data[i].Width = width;
-			m_Data[i].Channels = 3;
-			m_Data[i].PixelSize = size;
-			memcpy(m_Data[i].ColorData, data, size * sizeof(Vec3));
+				nullptr, level.Width, level.Height, 0, stbir_pixel_layout::STBIR_RGB);
+			PackRGB9E5Pixels((const Vec3*)data, m_Data + level.Offset, level.Width * level.Height);
 			stbi_image_free(data);
-
-			width /= 2;
-			height /= 2;
 		}
 
 		stbi_image_free(in_data);
 	}
 
+	LodTextureSphere::LodTextureSphere(const Vec3* levels, const int width, const int height, const int levelCount) {
+		ASSERT(levels && levelCount > 0 && (width >> (levelCount - 1)) > 0 && (height >> (levelCount - 1)) > 0);
+		for (int i = 0; i < levelCount; i++)
+			AddLevel(width >> i, height >> i);
+		Allocate();
+
+		size_t total = 0;
+		for (const Level& level : m_Levels)
+			total += (size_t)level.Width * level.Height;
+		PackRGB9E5Pixels(levels, m_Data, (int)total);
+	}
+
 	LodTextureSphere::~LodTextureSphere() {
-		for (auto data : m_Data) {
-			delete data.ColorData;
+		delete[] m_Data;
+		m_Data = nullptr;
+	}
+
+	void LodTextureSphere::AddLevel(const int width, const int height) {
+		Level level;
+		level.Width = width;
+		level.Height = height;
+		level.ScaleX = (float)(width - 1);
+		level.ScaleY = (float)(height - 1);
+		level.Offset = 0;
+		m_Levels.push_back(level);
+	}
+
+	void LodTextureSphere::Allocate() {
+		size_t total = 0;
+		for (Level& level : m_Levels) {
+			level.Offset = total;
+			total += (size_t)level.Width * level.Height;
 		}
+		m_Data = new uint32_t[total];
 	}
 
+	// Levels are numbered 0.hdr, 1.hdr, ... in the directory, loading stops at the first missing one.
 	LodTextureSphere* LodTextureSphere::LoadLodTextureSphere(const std::string& path, LoadType loadType) {
 		if (loadType == LoadType::SingleFile)
 			ASSERT(false);
 		else if (loadType == LoadType::Directory) {
-			stbi_set_flip_vertically_on_load(true);
-			int width, height, channels, size;
-			float* data;
-			LodTextureSphere* res = new LodTextureSphere();
-			res->m_Path = path;
-			for (int i = 0; i < 5; i++) {
+			std::vector<std::string> paths;
+			for (int i = 0;; i++) {
 				std::string loadPath{ path };
-				loadPath.append("\\");
+				loadPath.append("/");
 				loadPath.append(std::to_string(i));
 				loadPath.append(".hdr");
-
-				data = stbi_loadf(loadPath.c_str(), &width, &height, &channels, 0);
-
-				ASSERT((data) && (width > 0) && (height > 0) && (channels == 3));
-				size = height * width;
-				res->m_Data[i].Height = height;
-				res->m_Data[i].Width = width;
-				res->m_Data[i].Channels = channels;
-				res->m_Data[i].PixelSize = size;
-				res->m_Data[i].ColorData = new Vec3[size];
-				memcpy(res->m_Data[i].ColorData, data, size * sizeof(Vec3));
-				stbi_image_free(data);
+				if (!std::ifstream(loadPath))
+					break;
+				paths.push_back(loadPath);
 			}
+			if (paths.empty())
+				return nullptr;
+
+			LodTextureSphere* res = new LodTextureSphere(paths);
+			res->m_Path = path;
 			return res;
 		}
 		ASSERT(false);
 		return nullptr;
 	}
 
+	Vec3 LodTextureSphere::SampleLevel(const Level& level, const float u, const float v) const {
+		const float fx = u * level.ScaleX + 0.5f;
+		const float fy = v * level.ScaleY + 0.5f;
+		const int x0 = (int)fx;
+		const int y0 = (int)fy;
+		const float dx = fx - x0;
+		const float dy = fy - y0;
+
+		// Wraps around the seam, clamps at the poles.
+		const int x = x0 % level.Width;
+		const int x1 = (x0 + 1) % level.Width;
+		const int y = std::min<int>(y0, level.Height - 1);
+		const int y1 = std::min<int>(y0 + 1, level.Height - 1);
+
+		const uint32_t* row0 = m_Data + level.Offset + (size_t)y * level.Width;
+		const uint32_t* row1 = m_Data + level.Offset + (size_t)y1 * level.Width;
+		const Vec3 c0 = UnpackRGB9E5(row0[x]) * (1.0f - dx) + UnpackRGB9E5(row0[x1]) * dx;
+		const Vec3 c1 = UnpackRGB9E5(row1[x]) * (1.0f - dx) + UnpackRGB9E5(row1[x1]) * dx;
+		return c0 * (1.0f - dy) + c1 * dy;
+	}
+
 	Vec3 LodTextureSphere::Sample(const Vec3& v3, float lod) const {
-		ASSERT((lod >= 0) && (lod <= (float)4));
-		int number = (int)floor(lod);
-		float frac = fmod(lod, 1.0f);
+		lod = Clamp(lod, 0.0f, (float)(m_Levels.size() - 1));
+		const int level0 = (int)lod;
+		const float frac = lod - level0;
 
+		// The direction mapping is shared by both levels.
 		Vec3 dir = Normalize(v3);
-		float phi = atan2(dir.Z, dir.X);
-		float theta = acos(dir.Y);
-		float u = phi / (2.0f * PI) + 0.5f;
-		float v = 1.0f - theta / PI;
+		float u = atan2(dir.Z, dir.X) / (2.0f * PI) + 0.5f;
+		float v = 1.0f - acos(Clamp(dir.Y, -1.0f, 1.0f)) / PI;
 
-#if 1
-		if (number == 4) {
-			u = u * (m_Data[4].Width - 1) + 0.5f;
-			v = v * (m_Data[4].Height - 1) + 0.5f;
-			int x = (int)floor(u);
-			int y = (int)floor(v);
-			float fracX = fmod(u, 1.0f);
-			float fracY = fmod(v, 1.0f);
-
-			Vec3 res{ 0.0f, 0.0f, 0.0f };
-			res += GetColor(x, y, 4) * (1.0f - fracX) * (1.0f - fracY);
-			res += GetColor(x + 1, y, 4) * fracX * (1.0f - fracY);
-			res += GetColor(x, y + 1, 4) * (1.0f - fracX) * fracY;
-			res += GetColor(x + 1, y + 1, 4) * fracX * fracY;
-			return res;
+		const Vec3 c0 = SampleLevel(m_Levels[level0], u, v);
+		if (frac <= 0.0f)
+			return c0;
+		return Lerp(c0, SampleLevel(m_Levels[level0 + 1], u, v), frac);
+	}
+
+	// Major axis face selection, returns the face and u, v in [0, 1] on it.
+	static int SelectCubeFace(const Vec3& dir, float& u, float& v) {
+		const float ax = abs(dir.X);
+		const float ay = abs(dir.Y);
+		const float az = abs(dir.Z);
+
+		int face;
+		float ma, sc, tc;
+		if (ax >= ay && ax >= az) {
+			face = dir.X >= 0.0f ? 0 : 1;
+			ma = ax;
+			sc = dir.X >= 0.0f ? -dir.Z : dir.Z;
+			tc = -dir.Y;
+		}
+		else if (ay >= az) {
+			face = dir.Y >= 0.0f ? 2 : 3;
+			ma = ay;
+			sc = dir.X;
+			tc = dir.Y >= 0.0f ? dir.Z : -dir.Z;
 		}
 		else {
-			float u0 = u * (m_Data[number].Width - 1) + 0.5f;
-			float v0 = v * (m_Data[number].Height - 1) + 0.5f;
-			int x0 = (int)floor(u0);
-			int y0 = (int)floor(v0);
-			float fracX0 = fmod(u0, 1.0f);
-			float fracY0 = fmod(v0, 1.0f);
-
-			Vec3 c0{ 0.0f, 0.0f, 0.0f };
-			c0 += GetColor(x0, y0, number) * (1.0f - fracX0) * (1.0f - fracY0);
-			c0 += GetColor(x0 + 1, y0, number) * fracX0 * (1.0f - fracY0);
-			c0 += GetColor(x0, y0 + 1, number) * (1.0f - fracX0) * fracY0;
-			c0 += GetColor(x0 + 1, y0 + 1, number) * fracX0 * fracY0;
-
-			float u1 = u * (m_Data[number + 1].Width - 1) + 0.5f;
-			float v1 = v * (m_Data[number + 1].Height - 1) + 0.5f;
-			int x1 = (int)floor(u1);
-			int y1 = (int)floor(v1);
-			float fracX1 = fmod(u1, 1.0f);
-			float fracY1 = fmod(v1, 1.0f);
-
-			Vec3 c1{ 0.0f, 0.0f, 0.0f };
-			c1 += GetColor(x1, y1, number + 1) * (1.0f - fracX1) * (1.0f - fracY1);
-			c1 += GetColor(x1 + 1, y1, number + 1) * fracX1 * (1.0f - fracY1);
-			c1 += GetColor(x1, y1 + 1, number + 1) * (1.0f - fracX1) * fracY1;
-			c1 += GetColor(x1 + 1, y1 + 1, number + 1) * fracX1 * fracY1;
-
-			Vec3 color = Lerp(c0, c1, frac);
-			return color;
-		}
-#else
-		if (number == 4)
-		{
-			u = u * (m_Data[4].Width - 1) + 0.5f;
-			v = v * (m_Data[4].Height - 1) + 0.5f;
-
-			int x = floor(u);
-			int y = floor(v);
-
-			int index = (int)y * m_Data[4].Width + (int)x;
-			return m_Data[4].ColorData[index];
+			face = dir.Z >= 0.0f ? 4 : 5;
+			ma = az;
+			sc = dir.Z >= 0.0f ? dir.X : -dir.X;
+			tc = -dir.Y;
 		}
-		else
-		{
-			int x0 = u * (m_Data[number].Width - 1) + 0.5f;
-			int y0 = v * (m_Data[number].Height - 1) + 0.5f;
-			int index0 = y0 * m_Data[number].Width + x0;
 
-			int x1 = u * (m_Data[number + 1].Width - 1) + 0.5f;
-			int y1 = v * (m_Data[number + 1].Height - 1) + 0.5f;
-			int index1 = y1 * m_Data[number + 1].Width + x1;
+		const float scale = 0.5f / ma;
+		u = sc * scale + 0.5f;
+		v = tc * scale + 0.5f;
+		return face;
+	}
+
+	// Inverse of SelectCubeFace with s, t = 2 * (u, v) - 1.
+	static Vec3 GetCubeDirection(const int face, const float s, const float t) {
+		switch (face) {
+		case 0: return Vec3(1.0f, -t, -s);
+		case 1: return Vec3(-1.0f, -t, s);
+		case 2: return Vec3(s, 1.0f, t);
+		case 3: return Vec3(s, -1.0f, -t);
+		case 4: return Vec3(s, -t, 1.0f);
+		default: return Vec3(-s, -t, -1.0f);
+		}
+	}
+
+	static Vec3 SampleEquirect(const TextureSphere& sphere, const Vec3& dir) {
+		const int width = sphere.GetWidth();
+		const int height = sphere.GetHeight();
+		const float u = atan2(dir.Z, dir.X) / (2.0f * PI) + 0.5f;
+		const float v = 1.0f - acos(Clamp(dir.Y, -1.0f, 1.0f)) / PI;
+		const float fx = u * (width - 1);
+		const float fy = v * (height - 1);
+
+		const int x0 = std::min<int>((int)fx, width - 1);
+		const int y0 = std::min<int>((int)fy, height - 1);
+		const int x1 = (x0 + 1) % width;
+		const int y1 = std::min<int>(y0 + 1, height - 1);
+		const float dx = fx - x0;
+		const float dy = fy - y0;
+
+		const Vec3 c0 = sphere.GetColor(x0, y0) * (1.0f - dx) + sphere.GetColor(x1, y0) * dx;
+		const Vec3 c1 = sphere.GetColor(x0, y1) * (1.0f - dx) + sphere.GetColor(x1, y1) * dx;
+		return c0 * (1.0f - dy) + c1 * dy;
+	}
+
+	TextureCube::TextureCube(const TextureSphere& sphere, const int faceSize) {
+		ASSERT(faceSize > 0);
+		int levelCount = 1;
+		while ((faceSize >> levelCount) > 0)
+			levelCount++;
+		std::vector<Vec3> texels(Allocate(faceSize, levelCount));
+
+		ParallelFor(0, 6 * faceSize, [&](const int begin, const int end) {
+			for (int row = begin; row < end; row++) {
+				const int face = row / faceSize;
+				const int y = row % faceSize;
+				Vec3* dst = texels.data() + GetFaceOffset(0, face) + (y + 1) * (faceSize + 2) + 1;
+				const float t = 2.0f * (y + 0.5f) / faceSize - 1.0f;
+				for (int x = 0; x < faceSize; x++) {
+					const float s = 2.0f * (x + 0.5f) / faceSize - 1.0f;
+					dst[x] = SampleEquirect(sphere, Normalize(GetCubeDirection(face, s, t)));
+				}
+			}
+		});
+		FillBorders(texels.data(), 0);
+
+		for (int level = 1; level < levelCount; level++) {
+			DownsampleLevel(texels.data(), level);
+			FillBorders(texels.data(), level);
+		}
+		PackRGB9E5Pixels(texels.data(), m_Data, (int)texels.size());
+	}
+
+	TextureCube::TextureCube(const std::string& path, const int faceSize)
+		: TextureCube(TextureSphere(path), faceSize) {
+	}
 
-			Vec3 c0 = m_Data[number].ColorData[index0];
-			Vec3 c1 = m_Data[number + 1].ColorData[index1];
-			Vec3 color = Lerp(c0, c1, frac);
-			return color;
+	TextureCube::TextureCube(const LodTextureSphere& sphere, const int faceSize) {
+		const int levelCount = sphere.GetLevelCount();
+		ASSERT((faceSize >> (levelCount - 1)) > 0);
+		std::vector<Vec3> texels(Allocate(faceSize, levelCount));
+
+		for (int level = 0; level < levelCount; level++) {
+			const int size = m_Levels[level].Size;
+			ParallelFor(0, 6 * size, [&](const int begin, const int end) {
+				for (int row = begin; row < end; row++) {
+					const int face = row / size;
+					const int y = row % size;
+					Vec3* dst = texels.data() + GetFaceOffset(level, face) + (y + 1) * (size + 2) + 1;
+					const float t = 2.0f * (y + 0.5f) / size - 1.0f;
+					for (int x = 0; x < size; x++) {
+						const float s = 2.0f * (x + 0.5f) / size - 1.0f;
+						dst[x] = sphere.Sample(GetCubeDirection(face, s, t), (float)level);
+					}
+				}
+			});
+			FillBorders(texels.data(), level);
 		}
-#endif 
+		PackRGB9E5Pixels(texels.data(), m_Data, (int)texels.size());
+	}
 
-		return { 0.0f, 0.0f, 0.0f };
+	TextureCube::~TextureCube() {
+		delete[] m_Data;
+		m_Data = nullptr;
+	}
+
+	size_t TextureCube::Allocate(const int faceSize, const int levelCount) {
+		m_FaceSize = faceSize;
+		m_Levels.resize(levelCount);
+
+		size_t total = 0;
+		for (int level = 0; level < levelCount; level++) {
+			const int size = std::max<int>(faceSize >> level, 1);
+			m_Levels[level].Size = size;
+			m_Levels[level].Offset = total;
+			total += (size_t)6 * (size + 2) * (size + 2);
+		}
+		m_Data = new uint32_t[total];
+		return total;
+	}
+
+	// Border texels take the nearest texel of the face their direction falls on.
+	void TextureCube::FillBorders(Vec3* texels, const int level) const {
+		const int size = m_Levels[level].Size;
+		const int stride = size + 2;
+		for (int face = 0; face < 6; face++) {
+			Vec3* dst = texels + GetFaceOffset(level, face);
+			for (int y = 0; y < stride; y++) {
+				for (int x = 0; x < stride; x++) {
+					if (x != 0 && x != stride - 1 && y != 0 && y != stride - 1)
+						continue;
+
+					const float s = 2.0f * (x - 0.5f) / size - 1.0f;
+					const float t = 2.0f * (y - 0.5f) / size - 1.0f;
+					float u, v;
+					const int srcFace = SelectCubeFace(GetCubeDirection(face, s, t), u, v);
+					const int srcX = std::min<int>(std::max<int>((int)(u * size), 0), size - 1);
+					const int srcY = std::min<int>(std::max<int>((int)(v * size), 0), size - 1);
+					dst[y * stride + x] = texels[GetFaceOffset(level, srcFace) + (srcY + 1) * stride + srcX + 1];
+				}
+			}
+		}
+	}
+
+	void TextureCube::DownsampleLevel(Vec3* texels, const int level) const {
+		const int size = m_Levels[level].Size;
+		const int srcSize = m_Levels[level - 1].Size;
+		const int stride = size + 2;
+		const int srcStride = srcSize + 2;
+		for (int face = 0; face < 6; face++) {
+			const Vec3* src = texels + GetFaceOffset(level - 1, face);
+			Vec3* dst = texels + GetFaceOffset(level, face);
+			for (int y = 0; y < size; y++) {
+				for (int x = 0; x < size; x++) {
+					const int sx = std::min<int>(x * 2, srcSize - 1) + 1;
+					const int sy = std::min<int>(y * 2, srcSize - 1) + 1;
+					const int sx1 = std::min<int>(sx + 1, srcSize);
+					const int sy1 = std::min<int>(sy + 1, srcSize);
+					dst[(y + 1) * stride + x + 1] = (src[sy * srcStride + sx] + src[sy * srcStride + sx1] +
+						src[sy1 * srcStride + sx] + src[sy1 * srcStride + sx1]) * 0.25f;
+				}
+			}
+		}
+	}
+
+	Vec3 TextureCube::SampleLevel(const int face, const float u, const float v, const int level) const {
+		const int size = m_Levels[level].Size;
+		const int stride = size + 2;
+
+		// Texel i of the face is at i + 1 because of the border.
+		const float fx = Clamp(u * size + 0.5f, 0.0f, (float)size);
+		const float fy = Clamp(v * size + 0.5f, 0.0f, (float)size);
+		const int x = std::min<int>((int)fx, size);
+		const int y = std::min<int>((int)fy, size);
+		const float dx = fx - x;
+		const float dy = fy - y;
+
+		const uint32_t* row0 = m_Data + GetFaceOffset(level, face) + y * stride + x;
+		const uint32_t* row1 = row0 + stride;
+		const Vec3 c0 = UnpackRGB9E5(row0[0]) * (1.0f - dx) + UnpackRGB9E5(row0[1]) * dx;
+		const Vec3 c1 = UnpackRGB9E5(row1[0]) * (1.0f - dx) + UnpackRGB9E5(row1[1]) * dx;
+		return c0 * (1.0f - dy) + c1 * dy;
+	}
+
+	Vec3 TextureCube::Sample(const Vec3& v3) const {
+		float u, v;
+		const int face = SelectCubeFace(v3, u, v);
+		return SampleLevel(face, u, v, 0);
+	}
+
+	Vec3 TextureCube::Sample(const Vec3& v3, float lod) const {
+		lod = Clamp(lod, 0.0f, (float)(m_Levels.size() - 1));
+		const int level0 = (int)lod;
+		const int level1 = std::min<int>(level0 + 1, (int)m_Levels.size() - 1);
+		const float frac = lod - level0;
+
+		float u, v;
+		const int face = SelectCubeFace(v3, u, v);
+		const Vec3 c0 = SampleLevel(face, u, v, level0);
+		if (frac <= 0.0f)
+			return c0;
+		return Lerp(c0, SampleLevel(face, u, v, level1), frac);
+	}
+
+	struct VirtualPageHeader {
+		uint32_t Magic;
+		uint32_t Version;
+		int32_t Width, Height;
+		int32_t PageSize;
+		int32_t LevelCount;
+	};
+
+	// Halves the size down to the first level that fits in one page, pages of all levels are numbered fine to coarse.
+	std::vector<VirtualTexture::Level> VirtualTexture::GetLevels(const int width, const int height, const int pageSize, int& pageCount) {
+		std::vector<Level> levels;
+		pageCount = 0;
+		int levelWidth = width;
+		int levelHeight = height;
+		while (true) {
+			Level level;
+			level.Width = levelWidth;
+			level.Height = levelHeight;
+			level.PagesX = (levelWidth + pageSize - 1) / pageSize;
+			level.PagesY = (levelHeight + pageSize - 1) / pageSize;
+			level.FirstPage = pageCount;
+			pageCount += level.PagesX * level.PagesY;
+			levels.push_back(level);
+			if (levelWidth <= pageSize && levelHeight <= pageSize)
+				break;
+			levelWidth = std::max<int>(levelWidth / 2, 1);
+			levelHeight = std::max<int>(levelHeight / 2, 1);
+		}
+		return levels;
+	}
+
+	bool VirtualTexture::BuildPageFile(const std::string& imagePath, const std::string& pageFilePath, const int pageSize) {
+		ASSERT(pageSize > 0);
+		int width, height, channels;
+		stbi_set_flip_vertically_on_load(1);
+		stbi_uc* data = stbi_load(imagePath.c_str(), &width, &height, &channels, 4);
+		if (!data)
+			return false;
+
+		std::vector<uint32_t> texels((size_t)width * height);
+		memcpy(texels.data(), data, texels.size() * sizeof(uint32_t));
+		stbi_image_free(data);
+
+		std::ofstream file(pageFilePath, std::ios::binary | std::ios::trunc);
+		if (!file)
+			return false;
+
+		int pageCount;
+		const std::vector<Level> levels = GetLevels(width, height, pageSize, pageCount);
+		VirtualPageHeader header = {
+			RTL_VIRTUAL_PAGE_MAGIC, RTL_VIRTUAL_PAGE_VERSION, width, height, pageSize, (int32_t)levels.size()
+		};
+		file.write((const char*)&header, sizeof(header));
+
+		const int stride = pageSize + 2;
+		std::vector<uint32_t> page((size_t)stride * stride);
+		std::vector<uint32_t> next;
+		for (size_t l = 0; l < levels.size(); l++) {
+			const Level& level = levels[l];
+			if (l > 0) {
+				// 2x2 box filter from the previous level, the last row or column repeats for odd sizes.
+				const int srcWidth = levels[l - 1].Width;
+				const int srcHeight = levels[l - 1].Height;
+				next.resize((size_t)level.Width * level.Height);
+				ParallelFor(0, level.Height, [&](const int begin, const int end) {
+					for (int y = begin; y < end; y++) {
+						const uint32_t* row0 = texels.data() + std::min<int>(y * 2, srcHeight - 1) * srcWidth;
+						const uint32_t* row1 = texels.data() + std::min<int>(y * 2 + 1, srcHeight - 1) * srcWidth;
+						for (int x = 0; x < level.Width; x++) {
+							const int x0 = std::min<int>(x * 2, srcWidth - 1);
+							const int x1 = std::min<int>(x * 2 + 1, srcWidth - 1);
+							uint32_t out = 0;
+							for (int shift = 0; shift < 32; shift += 8) {
+								const uint32_t sum = ((row0[x0] >> shift) & 0xFFu) + ((row0[x1] >> shift) & 0xFFu) +
+									((row1[x0] >> shift) & 0xFFu) + ((row1[x1] >> shift) & 0xFFu);
+								out |= ((sum + 2) / 4) << shift;
+							}
+							next[x + y * level.Width] = out;
+						}
+					}
+				});
+				texels.swap(next);
+			}
+
+			for (int py = 0; py < level.PagesY; py++) {
+				for (int px = 0; px < level.PagesX; px++) {
+					for (int j = 0; j < stride; j++) {
+						const int y = std::min<int>(std::max<int>(py * pageSize + j - 1, 0), level.Height - 1);
+						for (int i = 0; i < stride; i++) {
+							const int x = std::min<int>(std::max<int>(px * pageSize + i - 1, 0), level.Width - 1);
+							page[i + j * stride] = texels[x + y * level.Width];
+						}
+					}
+					file.write((const char*)page.data(), page.size() * sizeof(uint32_t));
+				}
+			}
+		}
+		return (bool)file;
+	}
+
+	VirtualTexture::VirtualTexture(const std::string& pageFilePath, const int cachePageCount)
+		: m_File(pageFilePath, std::ios::binary) {
+		VirtualPageHeader header;
+		if (!m_File || !m_File.read((char*)&header, sizeof(header)) ||
+			header.Magic != RTL_VIRTUAL_PAGE_MAGIC || header.Version != RTL_VIRTUAL_PAGE_VERSION ||
+			header.Width <= 0 || header.Height <= 0 || header.PageSize <= 0) {
+			ASSERT(false);
+			return;
+		}
+
+		std::vector<Level> levels = GetLevels(header.Width, header.Height, header.PageSize, m_PageCount);
+		if ((int)levels.size() != header.LevelCount) {
+			ASSERT(false);
+			return;
+		}
+		m_Width = header.Width;
+		m_Height = header.Height;
+		m_PageSize = header.PageSize;
+		m_Levels = std::move(levels);
+
+		m_PageSlots.assign(m_PageCount, -1);
+		m_Requested.reset(new std::atomic<uint8_t>[m_PageCount]);
+		for (int i = 0; i < m_PageCount; i++)
+			m_Requested[i].store(0, std::memory_order_relaxed);
+
+		// The coarsest level is pinned in the first slots so every sample has a resident fallback.
+		const Level& coarsest = m_Levels.back();
+		const int pinnedPages = coarsest.PagesX * coarsest.PagesY;
+		const int slotCount = std::max<int>(cachePageCount, pinnedPages + 1);
+		m_Cache.resize((size_t)slotCount * GetStride() * GetStride());
+		m_SlotPages.assign(slotCount, -1);
+		m_SlotLastUsed.assign(slotCount, 0);
+		for (int i = 0; i < pinnedPages; i++)
+			LoadPage(coarsest.FirstPage + i, i);
+		m_PinnedSlots = pinnedPages;
+	}
+
+	bool VirtualTexture::LoadPage(const int page, const int slot) {
+		const int oldPage = m_SlotPages[slot];
+		if (oldPage >= 0) {
+			m_PageSlots[oldPage] = -1;
+			m_SlotPages[slot] = -1;
+			m_ResidentPageCount--;
+		}
+
+		const size_t pageTexels = (size_t)GetStride() * GetStride();
+		m_File.clear();
+		m_File.seekg((std::streamoff)sizeof(VirtualPageHeader) + (std::streamoff)page * pageTexels * sizeof(uint32_t));
+		if (!m_File.read((char*)(m_Cache.data() + slot * pageTexels), pageTexels * sizeof(uint32_t)))
+			return false;
+
+		m_SlotPages[slot] = page;
+		m_SlotLastUsed[slot] = m_Frame;
+		m_PageSlots[page] = slot;
+		m_ResidentPageCount++;
+		return true;
+	}
+
+	void VirtualTexture::Update(const int maxPageLoads) {
+		if (m_Levels.empty())
+			return;
+
+		std::vector<int> missing;
+		for (int page = 0; page < m_PageCount; page++) {
+			if (!m_Requested[page].load(std::memory_order_relaxed))
+				continue;
+			m_Requested[page].store(0, std::memory_order_relaxed);
+			const int slot = m_PageSlots[page];
+			if (slot >= 0)
+				m_SlotLastUsed[slot] = m_Frame;
+			else
+				missing.push_back(page);
+		}
+
+		// Coarse pages first, they are the fallback for everything finer.
+		std::sort(missing.begin(), missing.end(), std::greater<int>());
+		if ((int)missing.size() > maxPageLoads)
+			missing.resize(std::max<int>(maxPageLoads, 0));
+
+		// Free slots first, then the least recently requested ones, never a page requested this frame.
+		std::vector<int> victims;
+		for (int slot = m_PinnedSlots; slot < (int)m_SlotPages.size(); slot++) {
+			if (m_SlotPages[slot] < 0 || m_SlotLastUsed[slot] < m_Frame)
+				victims.push_back(slot);
+		}
+		std::sort(victims.begin(), victims.end(), [&](const int a, const int b) {
+			const bool freeA = m_SlotPages[a] < 0;
+			const bool freeB = m_SlotPages[b] < 0;
+			if (freeA != freeB)
+				return freeA;
+			return m_SlotLastUsed[a] < m_SlotLastUsed[b];
+		});
+
+		const size_t loadCount = std::min<size_t>(missing.size(), victims.size());
+		for (size_t i = 0; i < loadCount; i++)
+			LoadPage(missing[i], victims[i]);
+		m_Frame++;
+	}
+
+	float VirtualTexture::GetLod(const Vec2& texCoordsDx, const Vec2& texCoordsDy) const {
+		const float dxX = texCoordsDx.X * m_Width, dxY = texCoordsDx.Y * m_Height;
+		const float dyX = texCoordsDy.X * m_Width, dyY = texCoordsDy.Y * m_Height;
+		const float footprint = std::max<float>(dxX * dxX + dxY * dxY, dyX * dyX + dyY * dyY);
+		return 0.5f * std::log2(std::max<float>(footprint, 1e-8f));
+	}
+
+	Vec4 VirtualTexture::Sample(const Vec2& texCoords, const float lod) const {
+		if (m_Levels.empty())
+			return Vec4(0.0f);
+
+		const int levelCount = (int)m_Levels.size();
+		const float u = Clamp(texCoords.X, 0.0f, 1.0f);
+		const float v = Clamp(texCoords.Y, 0.0f, 1.0f);
+		const int stride = GetStride();
+		int level = std::min<int>(std::max<int>((int)std::floor(lod + 0.5f), 0), levelCount - 1);
+		bool requested = false;
+		for (; level < levelCount; level++) {
+			const Level& data = m_Levels[level];
+			const float fx = Clamp(u * data.Width - 0.5f, 0.0f, (float)(data.Width - 1));
+			const float fy = Clamp(v * data.Height - 0.5f, 0.0f, (float)(data.Height - 1));
+			const int x0 = (int)fx;
+			const int y0 = (int)fy;
+			const int px = x0 / m_PageSize;
+			const int py = y0 / m_PageSize;
+			const int page = data.FirstPage + px + py * data.PagesX;
+
+			// Only the level the caller wanted is reported, the check keeps threads from writing a shared line every sample.
+			if (!requested) {
+				requested = true;
+				if (!m_Requested[page].load(std::memory_order_relaxed))
+					m_Requested[page].store(1, std::memory_order_relaxed);
+			}
+
+			const int slot = m_PageSlots[page];
+			if (slot < 0)
+				continue;
+
+			// The border makes x0 + 1 and y0 + 1 valid inside the page.
+			const uint32_t* texels = m_Cache.data() + (size_t)slot * stride * stride;
+			const uint32_t* row0 = texels + (x0 - px * m_PageSize + 1) + (y0 - py * m_PageSize + 1) * stride;
+			const uint32_t* row1 = row0 + stride;
+			const uint32_t wx = (uint32_t)((fx - x0) * 256.0f + 0.5f);
+			const uint32_t wy = (uint32_t)((fy - y0) * 256.0f + 0.5f);
+			const uint32_t c0 = LerpRGBA8(row0[0], row0[1], wx);
+			const uint32_t c1 = LerpRGBA8(row1[0], row1[1], wx);
+			return UnpackRGBA8(LerpRGBA8(c0, c1, wy));
+		}
+		return Vec4(0.0f);
 	}
 
 }
@@ -1,34 +1,194 @@
 #pragma once
 #include "RTL/Base/Maths.h"
 #include "RTL/Window/Framebuffer.h"
+#include "RTL/Shader/BlockCompression.h"
 
 #include <string>
+#include <atomic>
+#include <memory>
+#include <fstream>
 #include <stb_image/stb_image.h>
 #include <stb_image/stb_image_resize2.h>
+#include <stb_image/stb_rect_pack.h>
+
+#define RTL_LOD_SPHERE_MIN_HEIGHT 16
+#define RTL_BLOCK_CACHE_SIZE 64
+#define RTL_ATLAS_PAGE_SIZE 1024
+#define RTL_ATLAS_PADDING 2
+#define RTL_VIRTUAL_PAGE_SIZE 128
+#define RTL_VIRTUAL_CACHE_PAGES 256
+#define RTL_VIRTUAL_PAGE_LOADS 32
 
 namespace RTL {
 
+	// SCALAR textures keep only the channel average as a 16-bit plane, for maps read through SampleFloat.
+	enum class TextureUsage {
+		COLOR,
+		SCALAR
+	};
+
+	enum class SamplerFilter {
+		NEAREST,
+		LINEAR
+	};
+
+	// CLAMP keeps the edge-to-edge mapping Texture::Sample always used, REPEAT and MIRROR tile the texture
+	// with texel centers at (i + 0.5) / size.
+	enum class SamplerWrap {
+		CLAMP,
+		REPEAT,
+		MIRROR
+	};
+
+	struct Sampler {
+		SamplerFilter Filter = SamplerFilter::LINEAR;
+		SamplerWrap WrapU = SamplerWrap::CLAMP;
+		SamplerWrap WrapV = SamplerWrap::CLAMP;
+	};
+
+	class Texture;
+
+	// A texture with its sampler resolved to one specialized sampling function, created by Texture::Bind.
+	class SampledTexture {
+	public:
+		SampledTexture() = default;
+
+		Vec4 Sample(const Vec2& texCoords) const { return m_Sample(*m_Texture, texCoords); }
+		explicit operator bool() const { return m_Texture != nullptr; }
+
+	private:
+		friend class Texture;
+		using sample_func_t = Vec4(*)(const Texture&, const Vec2&);
+
+		const Texture* m_Texture = nullptr;
+		sample_func_t m_Sample = nullptr;
+	};
+
 	class Texture {
 	public:
-		Texture(const std::string& path);
+		// COLOR textures are block compressed at load when compression is not NONE, ".dds" files keep the blocks they store.
+		Texture(const std::string& path, const TextureUsage usage = TextureUsage::COLOR,
+				const TextureCompression compression = TextureCompression::NONE);
 		Texture(const float value);
 		Texture(const Vec4& value);
+		Texture(const int width, const int height, const Vec4* data);
+		// RGBA8 texels with R in the low byte, as Texture stores images loaded from disk.
+		Texture(const int width, const int height, const uint32_t* texels, const int channels = 4);
 		~Texture();
 
 		Vec4 Sample(Vec2 texCoords, bool enableLerp = true, Vec4 defaultValue = Vec4(0.0f)) const;
 		float SampleFloat(Vec2 texCoords, bool enableLerp = true, float defaultValue = 0.0f) const;
 
+		// Filter and wrap are picked here once, the returned SampledTexture samples without per-call branches.
+		SampledTexture Bind(const Sampler& sampler) const;
+
+		// Occlusion, roughness and metallic in the R, G, B bytes of one RGBA8 texel, so a material needs one fetch
+		// for all three. Each map is reduced to the channel average SampleFloat would return and resized to the
+		// first map's size; an empty path uses the matching component of defaultValue.
+		static Texture* LoadORM(const std::string& aoPath, const std::string& roughnessPath, const std::string& metallicPath,
+								const Vec3& defaultValue = Vec3(1.0f, 0.5f, 0.0f));
+
 		int GetWidth() const { return m_Width; }
 		int GetHeight() const { return m_Height; }
 		std::string GetPath() const { return m_Path; }
 
 	private:
 		void Init();
+		void InitScalar();
+		void InitCompressed(const TextureCompression compression);
+		uint32_t FetchBlockTexel(const int x, const int y) const;
+		float SampleScalar(Vec2 texCoords, bool enableLerp) const;
+
+		enum class TexelFormat {
+			FLOAT4,
+			RGBA8,
+			BLOCK,
+			R16
+		};
+
+		template<TexelFormat format>
+		uint32_t FetchRGBA8(const int x, const int y) const {
+			if (format == TexelFormat::BLOCK)
+				return FetchBlockTexel(x, y);
+			return m_Texels[x + y * m_Width];
+		}
+
+		template<SamplerFilter filter, SamplerWrap wrapU, SamplerWrap wrapV, TexelFormat format>
+		static Vec4 SampleTexels(const Texture& texture, const Vec2& texCoords);
+		template<SamplerFilter filter, TexelFormat format>
+		static SampledTexture::sample_func_t SelectSampleFunc(const SamplerWrap wrapU, const SamplerWrap wrapV);
+		static Vec4 SampleConstant(const Texture& texture, const Vec2&) { return texture.m_Data[0]; }
 
 	private:
 		int m_Width, m_Height, m_Channels;
 		std::string m_Path;
-		Vec4* m_Data;
+		Vec4* m_Data = nullptr;
+		// Images loaded from disk keep their 8-bit texels, filtered with 8.8 fixed-point weights.
+		uint32_t* m_Texels = nullptr;
+		uint16_t* m_Scalar = nullptr;
+
+		// Blocks are stored with top-down block rows and decoded to RGBA8 through a small per-thread cache.
+		uint8_t* m_Blocks = nullptr;
+		TextureCompression m_Compression = TextureCompression::NONE;
+		int m_BlocksX = 0;
+		uint32_t m_BlockCacheKey = 0;
+
+		// Set by the value constructors, SampleFloat then returns m_ConstantScalar without a fetch.
+		bool m_IsConstant = false;
+		float m_ConstantScalar = 0.0f;
+	};
+
+	// Where one atlas entry lives, page texture coordinates are Offset + texCoords * Scale.
+	struct AtlasRegion {
+		int Page = -1;
+		int Channels = 0;
+		Vec2 Offset = Vec2(0.0f, 0.0f);
+		Vec2 Scale = Vec2(0.0f, 0.0f);
+	};
+
+	// Packs many small images into shared RGBA8 pages with stb_rect_pack, each surrounded by replicated edge texels.
+	// Sampling a region clamps to it and matches sampling the image as its own Texture.
+	class TextureAtlas {
+	public:
+		TextureAtlas(const int pageSize = RTL_ATLAS_PAGE_SIZE, const int padding = RTL_ATLAS_PADDING);
+
+		// Queues an image and returns its region index, regions are placed by Build.
+		int Add(const std::string& path);
+		int Add(const int width, const int height, const int channels, const uint8_t* pixels);
+		void Build();
+
+		Vec4 Sample(const int region, Vec2 texCoords, bool enableLerp = true) const;
+		float SampleFloat(const int region, Vec2 texCoords, bool enableLerp = true) const;
+
+		Vec2 TransformTexCoords(const int region, const Vec2& texCoords) const;
+		// Bakes the region transform into a mesh whose texture coordinates stay in [0, 1], so it samples the page directly.
+		template<typename mesh_t>
+		void RemapTexCoords(const int region, mesh_t& mesh) const {
+			for (auto& triangle : mesh) {
+				for (int i = 0; i < 3; i++)
+					triangle[i].TexCoord = TransformTexCoords(region, triangle[i].TexCoord);
+			}
+		}
+
+		const AtlasRegion& GetRegion(const int region) const { return m_Regions[region]; }
+		const Texture* GetPage(const int page) const { return m_Pages[page].get(); }
+		int GetPageCount() const { return (int)m_Pages.size(); }
+
+	private:
+		struct PendingImage {
+			int Region;
+			int Width, Height, Channels;
+			std::vector<uint8_t> Pixels;
+		};
+
+		void Place(const PendingImage& image, const int x, const int y, uint32_t* texels) const;
+
+	private:
+		int m_PageSize;
+		int m_Padding;
+		std::vector<PendingImage> m_Pending;
+		std::vector<AtlasRegion> m_Regions;
+		std::vector<std::unique_ptr<Texture>> m_Pages;
 	};
 
 	class TextureSphere {
@@ -38,6 +198,7 @@ namespace RTL {
 		~TextureSphere();
 
 		Vec3 Sample(const Vec3& v3) const;
+		Vec3 GetColor(int x, int y) const { return UnpackRGB9E5(m_Data[y * m_Width + x]); }
 
 		int GetWidth() const { return m_Width; }
 		int GetHeight() const { return m_Height; }
@@ -51,23 +212,26 @@ namespace RTL {
 	protected:
 		int m_Width, m_Height, m_Channels, m_PixelSize;
 		std::string m_Path;
-		Vec3* m_Data;
+		// RGB9E5
+		uint32_t* m_Data;
 	};
 
+	// Equirect levels of decreasing size, usually prefiltered for increasing roughness.
 	class LodTextureSphere {
 	public:
 		LodTextureSphere(std::vector<std::string> paths);
+		// Resizes the image into levels from the largest power of two width down to RTL_LOD_SPHERE_MIN_HEIGHT.
 		LodTextureSphere(std::string paths);
+		// levelCount levels stored back to back, level i is (width >> i) x (height >> i).
+		LodTextureSphere(const Vec3* levels, const int width, const int height, const int levelCount);
 		~LodTextureSphere();
 		Vec3 Sample(const Vec3& v3, float lod) const;
 
 		Vec3 GetColor(int x, int y, int lod) const {
-			const Data& data = m_Data[lod];
-			int width = data.Width;
-			int height = data.Height;
-			x %= width;
-			y %= height;
-			return data.ColorData[y * width + x];
+			const Level& level = m_Levels[lod];
+			x %= level.Width;
+			y %= level.Height;
+			return UnpackRGB9E5(m_Data[level.Offset + y * level.Width + x]);
 		}
 
 		enum class LoadType {
@@ -78,17 +242,126 @@ namespace RTL {
 		static LodTextureSphere* LoadLodTextureSphere(const std::string& path, LoadType loadType);
 
 		std::string GetPath() { return m_Path; }
+		int GetLevelCount() const { return (int)m_Levels.size(); }
+		int GetWidth(const int lod) const { return m_Levels[lod].Width; }
 
 	protected:
 		LodTextureSphere() = default;
 
+		struct Level {
+			int Width, Height;
+			// Maps u, v in [0, 1] to texel coordinates.
+			float ScaleX, ScaleY;
+			size_t Offset;
+		};
+
+		void AddLevel(const int width, const int height);
+		void Allocate();
+		Vec3 SampleLevel(const Level& level, const float u, const float v) const;
+
 		std::string m_Path;
 
-		struct Data {
-			int Width, Height, Channels, PixelSize;
-			Vec3* ColorData;
+		std::vector<Level> m_Levels;
+		// RGB9E5, all levels in one allocation.
+		uint32_t* m_Data = nullptr;
+	};
+
+	// Six faces in +X, -X, +Y, -Y, +Z, -Z order with a mip chain. Every face keeps a one texel border
+	// copied from its neighbours, so bilinear taps near an edge blend across faces without extra lookups.
+	class TextureCube {
+	public:
+		// Converts an equirect image, with a box filtered mip chain down to 1x1 faces.
+		TextureCube(const TextureSphere& sphere, const int faceSize);
+		TextureCube(const std::string& path, const int faceSize);
+		// One cube level per prefiltered level, level i has faces of (faceSize >> i).
+		TextureCube(const LodTextureSphere& sphere, const int faceSize);
+		~TextureCube();
+
+		Vec3 Sample(const Vec3& v3) const;
+		Vec3 Sample(const Vec3& v3, float lod) const;
+
+		int GetFaceSize() const { return m_FaceSize; }
+		int GetLevelCount() const { return (int)m_Levels.size(); }
+
+	private:
+		struct Level {
+			int Size;
+			// Offset of +X in m_Data, faces are (Size + 2)^2 texels including the border.
+			size_t Offset;
+		};
+
+		// Returns the texel count, levels are built as Vec3 in a staging buffer of that size and packed once.
+		size_t Allocate(const int faceSize, const int levelCount);
+		void FillBorders(Vec3* texels, const int level) const;
+		void DownsampleLevel(Vec3* texels, const int level) const;
+		Vec3 SampleLevel(const int face, const float u, const float v, const int level) const;
+
+		size_t GetFaceOffset(const int level, const int face) const {
+			const Level& data = m_Levels[level];
+			return data.Offset + (size_t)face * (data.Size + 2) * (data.Size + 2);
+		}
+
+	private:
+		int m_FaceSize;
+		std::vector<Level> m_Levels;
+		// RGB9E5, all levels in one allocation.
+		uint32_t* m_Data = nullptr;
+	};
+
+	// Mip-mapped RGBA8 texture streamed from a page file through a fixed-size page cache.
+	// Sample records the pages it wanted, Update loads them between frames and evicts the least recently used ones.
+	// Pages that are not resident fall back to the nearest coarser resident level, the coarsest level is always resident.
+	class VirtualTexture {
+	public:
+		VirtualTexture(const std::string& pageFilePath, const int cachePageCount = RTL_VIRTUAL_CACHE_PAGES);
+
+		// Offline step, splits the image and its mip chain into pages with a 1-texel border for filtering.
+		static bool BuildPageFile(const std::string& imagePath, const std::string& pageFilePath, const int pageSize = RTL_VIRTUAL_PAGE_SIZE);
+
+		// Safe to call from the rasterizer threads while no Update is running.
+		Vec4 Sample(const Vec2& texCoords, const float lod) const;
+		float GetLod(const Vec2& texCoordsDx, const Vec2& texCoordsDy) const;
+
+		// Call once per frame outside rendering, loads at most maxPageLoads requested pages, coarse levels first.
+		void Update(const int maxPageLoads = RTL_VIRTUAL_PAGE_LOADS);
+
+		bool IsValid() const { return !m_Levels.empty(); }
+		int GetWidth() const { return m_Width; }
+		int GetHeight() const { return m_Height; }
+		int GetLevelCount() const { return (int)m_Levels.size(); }
+		int GetResidentPageCount() const { return m_ResidentPageCount; }
+
+	private:
+		struct Level {
+			int Width, Height;
+			int PagesX, PagesY;
+			// Index of the first page of this level in the page file and the page tables.
+			int FirstPage;
 		};
-		Data m_Data[5];
+
+		static std::vector<Level> GetLevels(const int width, const int height, const int pageSize, int& pageCount);
+
+		int GetStride() const { return m_PageSize + 2; }
+		bool LoadPage(const int page, const int slot);
+
+	private:
+		int m_Width = 0, m_Height = 0;
+		int m_PageSize = 0;
+		int m_PageCount = 0;
+		std::vector<Level> m_Levels;
+		std::ifstream m_File;
+
+		// Per virtual page: cache slot or -1, and whether a sample asked for it since the last Update.
+		std::vector<int> m_PageSlots;
+		std::unique_ptr<std::atomic<uint8_t>[]> m_Requested;
+
+		// Per cache slot: bordered RGBA8 texels, the page it holds or -1, and the frame it was last requested in.
+		std::vector<uint32_t> m_Cache;
+		std::vector<int> m_SlotPages;
+		std::vector<uint32_t> m_SlotLastUsed;
+		int m_PinnedSlots = 0;
+		int m_ResidentPageCount = 0;
+		uint32_t m_Frame = 1;
 	};
 
 }
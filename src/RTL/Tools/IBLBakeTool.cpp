@@ -0,0 +1,41 @@
+#include "RTL/Shader/IBLBake.h"
+
+#include <iostream>
+#include <cstdlib>
+
+using namespace RTL;
+
+// rtl_ibl_bake <input.hdr> <output.ibl> [prefilterWidth] [prefilterSamples] [prefilterLevels]
+int main(int argc, char* argv[]) {
+	if (argc < 3) {
+		std::cout << "usage: rtl_ibl_bake <input.hdr> <output.ibl> [prefilterWidth] [prefilterSamples] [prefilterLevels]" << std::endl;
+		return 1;
+	}
+
+	IBLBakeSettings settings;
+	if (argc > 3)
+		settings.PrefilterWidth = std::atoi(argv[3]);
+	if (argc > 4)
+		settings.PrefilterSamples = (uint32_t)std::atoi(argv[4]);
+	if (argc > 5)
+		settings.PrefilterLevels = std::atoi(argv[5]);
+	if (settings.PrefilterLevels < 2 || settings.PrefilterLevels > 16 ||
+		(settings.PrefilterWidth >> settings.PrefilterLevels) <= 0 || settings.PrefilterSamples == 0) {
+		std::cout << "prefilterLevels must be 2 to 16, prefilterWidth at least 2^prefilterLevels and prefilterSamples positive" << std::endl;
+		return 1;
+	}
+
+	IBLBakedData* baked = IBLBakedData::Bake(argv[1], settings);
+	if (!baked) {
+		std::cout << "failed to load " << argv[1] << std::endl;
+		return 1;
+	}
+
+	const bool saved = baked->SaveCache(argv[2]);
+	delete baked;
+	if (!saved) {
+		std::cout << "failed to write " << argv[2] << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include "RTL/Base/Maths.h"
+
+#include <cstdint>
+
+namespace RTL {
+
+	enum class ColorFormat {
+		RGB32F,
+		RGBA8,
+		R11G11B10F,
+		RGBA16F
+	};
+
+	struct Half4 {
+		uint16_t R, G, B, A;
+	};
+
+	inline float Saturate(const float value) {
+		return value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+	}
+
+	template<ColorFormat format>
+	struct ColorTraits;
+
+	template<>
+	struct ColorTraits<ColorFormat::RGB32F> {
+		using pixel_t = Vec3;
+
+		static pixel_t Encode(const Vec3& color) { return color; }
+		static Vec3 Decode(const pixel_t& pixel) { return pixel; }
+
+		static void Blend(pixel_t& pixel, const Vec3& color, const float alpha) {
+			pixel.X += (color.X - pixel.X) * alpha;
+			pixel.Y += (color.Y - pixel.Y) * alpha;
+			pixel.Z += (color.Z - pixel.Z) * alpha;
+		}
+	};
+
+	template<>
+	struct ColorTraits<ColorFormat::RGBA8> {
+		using pixel_t = uint32_t;
+
+		static pixel_t Encode(const Vec3& color) {
+			return (uint32_t)(Saturate(color.X) * 255.0f + 0.5f) |
+				((uint32_t)(Saturate(color.Y) * 255.0f + 0.5f) << 8) |
+				((uint32_t)(Saturate(color.Z) * 255.0f + 0.5f) << 16) |
+				0xFF000000u;
+		}
+
+		static Vec3 Decode(const pixel_t pixel) {
+			constexpr float scale = 1.0f / 255.0f;
+			return Vec3(
+				(float)(pixel & 0xFFu) * scale,
+				(float)((pixel >> 8) & 0xFFu) * scale,
+				(float)((pixel >> 16) & 0xFFu) * scale);
+		}
+
+		// 8-bit fixed point: dst + (src - dst) * a / 256 per channel.
+		static void Blend(pixel_t& pixel, const Vec3& color, const float alpha) {
+			const int a = (int)(Saturate(alpha) * 256.0f + 0.5f);
+			const uint32_t src = Encode(color);
+			uint32_t out = 0xFF000000u;
+			for (int shift = 0; shift < 24; shift += 8) {
+				const int d = (int)((pixel >> shift) & 0xFFu);
+				const int s = (int)((src >> shift) & 0xFFu);
+				out |= (uint32_t)(d + (((s - d) * a) >> 8)) << shift;
+			}
+			pixel = out;
+		}
+	};
+
+	template<>
+	struct ColorTraits<ColorFormat::R11G11B10F> {
+		using pixel_t = uint32_t;
+
+		static pixel_t Encode(const Vec3& color) { return PackR11G11B10F(color); }
+		static Vec3 Decode(const pixel_t pixel) { return UnpackR11G11B10F(pixel); }
+
+		static void Blend(pixel_t& pixel, const Vec3& color, const float alpha) {
+			Vec3 dst = Decode(pixel);
+			ColorTraits<ColorFormat::RGB32F>::Blend(dst, color, alpha);
+			pixel = Encode(dst);
+		}
+	};
+
+	template<>
+	struct ColorTraits<ColorFormat::RGBA16F> {
+		using pixel_t = Half4;
+
+		static pixel_t Encode(const Vec3& color) {
+			return { Float2Half(color.X), Float2Half(color.Y), Float2Half(color.Z), 0x3C00 };
+		}
+
+		static Vec3 Decode(const pixel_t& pixel) {
+			return Vec3(Half2Float(pixel.R), Half2Float(pixel.G), Half2Float(pixel.B));
+		}
+
+		static void Blend(pixel_t& pixel, const Vec3& color, const float alpha) {
+			Vec3 dst = Decode(pixel);
+			ColorTraits<ColorFormat::RGB32F>::Blend(dst, color, alpha);
+			pixel = Encode(dst);
+		}
+	};
+
+	inline int GetColorFormatSize(const ColorFormat format) {
+		switch (format) {
+		case ColorFormat::RGBA8:
+			return (int)sizeof(ColorTraits<ColorFormat::RGBA8>::pixel_t);
+		case ColorFormat::R11G11B10F:
+			return (int)sizeof(ColorTraits<ColorFormat::R11G11B10F>::pixel_t);
+		case ColorFormat::RGBA16F:
+			return (int)sizeof(ColorTraits<ColorFormat::RGBA16F>::pixel_t);
+		default:
+			return (int)sizeof(ColorTraits<ColorFormat::RGB32F>::pixel_t);
+		}
+	}
+
+	// Calls func with a ColorTraits instance so the per-format path is resolved once per call, not per pixel.
+	template<typename func_t>
+	void DispatchColorFormat(const ColorFormat format, func_t&& func) {
+		switch (format) {
+		case ColorFormat::RGBA8:
+			func(ColorTraits<ColorFormat::RGBA8>());
+			break;
+		case ColorFormat::R11G11B10F:
+			func(ColorTraits<ColorFormat::R11G11B10F>());
+			break;
+		case ColorFormat::RGBA16F:
+			func(ColorTraits<ColorFormat::RGBA16F>());
+			break;
+		default:
+			func(ColorTraits<ColorFormat::RGB32F>());
+			break;
+		}
+	}
+
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "RTL/Base/Maths.h"
+
+#include <cstdint>
+
+namespace RTL {
+
+	// FLOAT32 stores clip-space Z, REVERSED_FLOAT32 stores 1 / W (infinite far plane at 0),
+	// UNORM16 / UNORM24 store window depth in [0, 1] as fixed point.
+	enum class DepthFormat {
+		FLOAT32,
+		REVERSED_FLOAT32,
+		UNORM16,
+		UNORM24
+	};
+
+	template<DepthFormat format>
+	struct DepthTraits;
+
+	template<>
+	struct DepthTraits<DepthFormat::FLOAT32> {
+		using depth_t = float;
+
+		static depth_t Encode(const float depth) { return depth; }
+		static float Decode(const depth_t depth) { return depth; }
+		static float GetFragmentDepth(const Vec4& clipPos) { return clipPos.Z; }
+
+		static bool Less(const depth_t depth, const depth_t stored) { return stored - depth > EPSILON; }
+		static bool LessEqual(const depth_t depth, const depth_t stored) { return depth - stored <= EPSILON; }
+		static depth_t GetNearer(const depth_t a, const depth_t b) { return a < b ? a : b; }
+	};
+
+	template<>
+	struct DepthTraits<DepthFormat::REVERSED_FLOAT32> {
+		using depth_t = float;
+
+		static depth_t Encode(const float depth) { return depth; }
+		static float Decode(const depth_t depth) { return depth; }
+		static float GetFragmentDepth(const Vec4& clipPos) { return 1.0f / clipPos.W; }
+
+		static bool Less(const depth_t depth, const depth_t stored) { return depth > stored; }
+		static bool LessEqual(const depth_t depth, const depth_t stored) { return depth >= stored; }
+		static depth_t GetNearer(const depth_t a, const depth_t b) { return a > b ? a : b; }
+	};
+
+	template<>
+	struct DepthTraits<DepthFormat::UNORM16> {
+		using depth_t = uint16_t;
+
+		static depth_t Encode(const float depth) { return (depth_t)(Clamp(depth, 0.0f, 1.0f) * 65535.0f + 0.5f); }
+		static float Decode(const depth_t depth) { return (float)depth * (1.0f / 65535.0f); }
+		static float GetFragmentDepth(const Vec4& clipPos) { return (clipPos.Z / clipPos.W + 1.0f) * 0.5f; }
+
+		static bool Less(const depth_t depth, const depth_t stored) { return depth < stored; }
+		static bool LessEqual(const depth_t depth, const depth_t stored) { return depth <= stored; }
+		static depth_t GetNearer(const depth_t a, const depth_t b) { return a < b ? a : b; }
+	};
+
+	template<>
+	struct DepthTraits<DepthFormat::UNORM24> {
+		using depth_t = uint32_t;
+
+		static depth_t Encode(const float depth) { return (depth_t)(Clamp(depth, 0.0f, 1.0f) * 16777215.0 + 0.5); }
+		static float Decode(const depth_t depth) { return (float)(depth * (1.0 / 16777215.0)); }
+		static float GetFragmentDepth(const Vec4& clipPos) { return (clipPos.Z / clipPos.W + 1.0f) * 0.5f; }
+
+		static bool Less(const depth_t depth, const depth_t stored) { return depth < stored; }
+		static bool LessEqual(const depth_t depth, const depth_t stored) { return depth <= stored; }
+		static depth_t GetNearer(const depth_t a, const depth_t b) { return a < b ? a : b; }
+	};
+
+	inline int GetDepthFormatSize(const DepthFormat format) {
+		switch (format) {
+		case DepthFormat::UNORM16:
+			return (int)sizeof(DepthTraits<DepthFormat::UNORM16>::depth_t);
+		case DepthFormat::UNORM24:
+			return (int)sizeof(DepthTraits<DepthFormat::UNORM24>::depth_t);
+		default:
+			return (int)sizeof(float);
+		}
+	}
+
+	// Depth value that is farther than anything the format can store a fragment at.
+	inline float GetFarDepth(const DepthFormat format, const float cameraFar) {
+		switch (format) {
+		case DepthFormat::REVERSED_FLOAT32:
+			return 0.0f;
+		case DepthFormat::UNORM16:
+		case DepthFormat::UNORM24:
+			return 1.0f;
+		default:
+			return cameraFar;
+		}
+	}
+
+	template<typename func_t>
+	void DispatchDepthFormat(const DepthFormat format, func_t&& func) {
+		switch (format) {
+		case DepthFormat::REVERSED_FLOAT32:
+			func(DepthTraits<DepthFormat::REVERSED_FLOAT32>());
+			break;
+		case DepthFormat::UNORM16:
+			func(DepthTraits<DepthFormat::UNORM16>());
+			break;
+		case DepthFormat::UNORM24:
+			func(DepthTraits<DepthFormat::UNORM24>());
+			break;
+		default:
+			func(DepthTraits<DepthFormat::FLOAT32>());
+			break;
+		}
+	}
+
+}
@@ -1,13 +1,72 @@
 #include "Framebuffer.h"
 
+#include "RTL/Base/Parallel.h"
+
+#include <type_traits>
+#include <thread>
+
+#ifdef RTL_SSE2
+#include <emmintrin.h>
+#endif
+
 namespace RTL {
 
-	Framebuffer::Framebuffer(const int width, const int height)
-		: m_Width(width), m_Height(height) {
+	static void ConvertRowBGR8(unsigned char* dst, const Vec3* src, const int count) {
+		int i = 0;
+#ifdef RTL_SSE2
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 scale = _mm_set1_ps(255.0f);
+		const __m128 half = _mm_set1_ps(0.5f);
+		for (; i + 4 <= count; i += 4) {
+			const float* f = (const float*)(src + i);
+			// a0 = r0 g0 b0 r1, a1 = g1 b1 r2 g2, a2 = b2 r3 g3 b3
+			__m128 a0 = _mm_loadu_ps(f);
+			__m128 a1 = _mm_loadu_ps(f + 4);
+			__m128 a2 = _mm_loadu_ps(f + 8);
+
+			__m128 t0 = _mm_shuffle_ps(a0, a0, _MM_SHUFFLE(0, 0, 1, 2));
+			__m128 s0 = _mm_shuffle_ps(a0, a1, _MM_SHUFFLE(1, 1, 0, 0));
+			__m128 b0 = _mm_shuffle_ps(t0, s0, _MM_SHUFFLE(2, 0, 1, 0));
+
+			__m128 s1 = _mm_shuffle_ps(a1, a0, _MM_SHUFFLE(3, 3, 0, 0));
+			__m128 s2 = _mm_shuffle_ps(a2, a1, _MM_SHUFFLE(3, 3, 0, 0));
+			__m128 b1 = _mm_shuffle_ps(s1, s2, _MM_SHUFFLE(2, 0, 2, 0));
+
+			__m128 s3 = _mm_shuffle_ps(a1, a2, _MM_SHUFFLE(3, 3, 2, 2));
+			__m128 b2 = _mm_shuffle_ps(s3, a2, _MM_SHUFFLE(1, 2, 2, 0));
+
+			__m128i i0 = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_min_ps(_mm_max_ps(b0, zero), one), scale), half));
+			__m128i i1 = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_min_ps(_mm_max_ps(b1, zero), one), scale), half));
+			__m128i i2 = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_min_ps(_mm_max_ps(b2, zero), one), scale), half));
+
+			__m128i bytes = _mm_packus_epi16(_mm_packs_epi32(i0, i1), _mm_packs_epi32(i2, i2));
+			alignas(16) unsigned char packed[16];
+			_mm_store_si128((__m128i*)packed, bytes);
+			memcpy(dst + i * 3, packed, 12);
+		}
+#endif
+		for (; i < count; i++) {
+			dst[i * 3 + 0] = Float2UChar(Clamp(src[i].Z, 0.0f, 1.0f));
+			dst[i * 3 + 1] = Float2UChar(Clamp(src[i].Y, 0.0f, 1.0f));
+			dst[i * 3 + 2] = Float2UChar(Clamp(src[i].X, 0.0f, 1.0f));
+		}
+	}
+
+	Framebuffer::Framebuffer(const int width, const int height, const ColorFormat colorFormat,
+							 const FramebufferLayout layout, const DepthFormat depthFormat)
+		: m_Width(width), m_Height(height), m_DepthFormat(depthFormat), m_Layout(layout), m_ColorFormat(colorFormat) {
 		ASSERT(width > 0 && height > 0);
-		m_PixelSize = m_Width * m_Height;
-		m_ColorBuffer = new Vec3[m_PixelSize]();
-		m_DepthBuffer = new float[m_PixelSize]();
+		m_TileCountX = (m_Width + RTL_TILE_MASK) >> RTL_TILE_SHIFT;
+		m_TileCountY = (m_Height + RTL_TILE_MASK) >> RTL_TILE_SHIFT;
+		if (m_Layout == FramebufferLayout::TILED)
+			m_PixelSize = (m_TileCountX * m_TileCountY) << (2 * RTL_TILE_SHIFT);
+		else
+			m_PixelSize = m_Width * m_Height;
+		m_ColorBuffer = new unsigned char[(size_t)m_PixelSize * GetColorFormatSize(m_ColorFormat)]();
+		m_DepthBuffer = new unsigned char[(size_t)m_PixelSize * GetDepthFormatSize(m_DepthFormat)]();
+		m_ColorTileStates = new std::atomic<TileState>[m_TileCountX * m_TileCountY];
+		m_DepthTileStates = new std::atomic<TileState>[m_TileCountX * m_TileCountY];
 		Clear();
 		ClearDepth();
 	}
@@ -15,153 +74,293 @@ namespace RTL {
 	Framebuffer::~Framebuffer() {
 		delete[] m_ColorBuffer;
 		delete[] m_DepthBuffer;
+		delete[] m_ColorTileStates;
+		delete[] m_DepthTileStates;
 		m_ColorBuffer = nullptr;
 		m_DepthBuffer = nullptr;
+		m_ColorTileStates = nullptr;
+		m_DepthTileStates = nullptr;
+	}
+
+	// Only the thread that moves a tile from CLEARED to BUSY fills it, others wait for VALID.
+	bool Framebuffer::BeginMaterialize(std::atomic<TileState>& state) {
+		TileState expected = TileState::CLEARED;
+		if (state.compare_exchange_strong(expected, TileState::BUSY, std::memory_order_acquire))
+			return true;
+		while (state.load(std::memory_order_acquire) != TileState::VALID)
+			std::this_thread::yield();
+		return false;
+	}
+
+	void Framebuffer::MaterializeColorTile(const int tile) const {
+		std::atomic<TileState>& state = m_ColorTileStates[tile];
+		if (!BeginMaterialize(state))
+			return;
+		DispatchColorFormat(m_ColorFormat, [&](auto traits) {
+			using traits_t = decltype(traits);
+			typename traits_t::pixel_t* pixels = GetColorData<traits_t>();
+			const typename traits_t::pixel_t pixel = traits_t::Encode(m_ClearColor);
+			ForEachTileSpan(tile, [&](const int index, const int count) {
+				std::fill(pixels + index, pixels + index + count, pixel);
+			});
+		});
+		state.store(TileState::VALID, std::memory_order_release);
+	}
+
+	void Framebuffer::MaterializeDepthTile(const int tile) const {
+		std::atomic<TileState>& state = m_DepthTileStates[tile];
+		if (!BeginMaterialize(state))
+			return;
+		DispatchDepthFormat(m_DepthFormat, [&](auto traits) {
+			using traits_t = decltype(traits);
+			typename traits_t::depth_t* depths = GetDepthData<traits_t>();
+			const typename traits_t::depth_t depth = traits_t::Encode(m_ClearDepth);
+			ForEachTileSpan(tile, [&](const int index, const int count) {
+				std::fill(depths + index, depths + index + count, depth);
+			});
+		});
+		state.store(TileState::VALID, std::memory_order_release);
 	}
 
 	void Framebuffer::SetColor(const int x, const int y, const Vec3& color) {
-		if (x >= 0 && x < m_Width && y >= 0 && y < m_Height)
-			m_ColorBuffer[x + y * m_Width] = color;
+		if (x >= 0 && x < m_Width && y >= 0 && y < m_Height) {
+			DispatchColorFormat(m_ColorFormat, [&](auto traits) {
+				using traits_t = decltype(traits);
+				AcquireColorTile(GetTileIndex(x, y));
+				GetColorData<traits_t>()[GetPixelIndex(x, y)] = traits_t::Encode(color);
+			});
+		}
 		else
 			ASSERT(false);
 	}
 
 	Vec3 Framebuffer::GetColor(const int x, const int y) const {
-		if (x >= 0 && x < m_Width && y >= 0 && y < m_Height)
-			return m_ColorBuffer[x + y * m_Width];
+		Vec3 color(0.0f, 0.0f, 0.0f);
+		if (x >= 0 && x < m_Width && y >= 0 && y < m_Height) {
+			DispatchColorFormat(m_ColorFormat, [&](auto traits) {
+				using traits_t = decltype(traits);
+				AcquireColorTile(GetTileIndex(x, y));
+				color = traits_t::Decode(GetColorData<traits_t>()[GetPixelIndex(x, y)]);
+			});
+		}
 		else
 			ASSERT(false);
-		return Vec3(0.0f, 0.0f, 0.0f);
+		return color;
+	}
+
+	void Framebuffer::BlendColor(const int x, const int y, const Vec3& color, const float alpha) {
+		if (x >= 0 && x < m_Width && y >= 0 && y < m_Height) {
+			DispatchColorFormat(m_ColorFormat, [&](auto traits) {
+				using traits_t = decltype(traits);
+				AcquireColorTile(GetTileIndex(x, y));
+				traits_t::Blend(GetColorData<traits_t>()[GetPixelIndex(x, y)], color, alpha);
+			});
+		}
+		else
+			ASSERT(false);
+	}
+
+	void Framebuffer::ReadColorRow(const int y, Vec3* dst) const {
+		ASSERT(y >= 0 && y < m_Height);
+		DispatchColorFormat(m_ColorFormat, [&](auto traits) {
+			using traits_t = decltype(traits);
+			const typename traits_t::pixel_t* pixels = GetColorData<traits_t>();
+			const Vec3 clearColor = traits_t::Decode(traits_t::Encode(m_ClearColor));
+			ForEachRowSpan(y, 0, m_Width, [&](const int index, const int tile, const int x, const int count) {
+				if (m_ColorTileStates[tile].load(std::memory_order_acquire) == TileState::CLEARED) {
+					std::fill(dst + x, dst + x + count, clearColor);
+					return;
+				}
+				AcquireColorTile(tile);
+				for (int i = 0; i < count; i++)
+					dst[x + i] = traits_t::Decode(pixels[index + i]);
+			});
+		});
 	}
 
 	void Framebuffer::SetDepth(const int x, const int y, const float depth) {
-		if (x >= 0 && x < m_Width && y >= 0 && y < m_Height)
-			m_DepthBuffer[x + y * m_Width] = depth;
+		if (x >= 0 && x < m_Width && y >= 0 && y < m_Height) {
+			AcquireDepthTile(GetTileIndex(x, y));
+			DispatchDepthFormat(m_DepthFormat, [&](auto traits) {
+				using traits_t = decltype(traits);
+				GetDepthData<traits_t>()[GetPixelIndex(x, y)] = traits_t::Encode(depth);
+			});
+		}
 		else
             ASSERT(false);
 	}
 
 	float Framebuffer::GetDepth(const int x, const int y) const {
-		if (x >= 0 && x < m_Width && y >= 0 && y < m_Height)
-			return m_DepthBuffer[x + y * m_Width];
+		if (x >= 0 && x < m_Width && y >= 0 && y < m_Height) {
+			AcquireDepthTile(GetTileIndex(x, y));
+			float depth = 0.0f;
+			DispatchDepthFormat(m_DepthFormat, [&](auto traits) {
+				using traits_t = decltype(traits);
+				depth = traits_t::Decode(GetDepthData<traits_t>()[GetPixelIndex(x, y)]);
+			});
+			return depth;
+		}
 		else
 			ASSERT(false);
 		return 1.0f;
 	}
 
 	void Framebuffer::Clear(const Vec3& color) {
-		for (int i = 0; i < m_PixelSize; i++)
-			m_ColorBuffer[i] = color;
+		m_ClearColor = color;
+		const int tileCount = m_TileCountX * m_TileCountY;
+		for (int i = 0; i < tileCount; i++)
+			m_ColorTileStates[i].store(TileState::CLEARED, std::memory_order_relaxed);
 	}
 
 	void Framebuffer::ClearDepth(const float depth) {
-		for (int i = 0; i < m_PixelSize; i++)
-			m_DepthBuffer[i] = depth;
+		m_ClearDepth = depth;
+		const int tileCount = m_TileCountX * m_TileCountY;
+		for (int i = 0; i < tileCount; i++)
+			m_DepthTileStates[i].store(TileState::CLEARED, std::memory_order_relaxed);
+	}
+
+	int Framebuffer::AddRenderTarget(const int elementSize) {
+		ASSERT(elementSize > 0);
+		m_RenderTargets.emplace_back((size_t)m_PixelSize * elementSize);
+		return (int)m_RenderTargets.size() - 1;
+	}
+
+	void Framebuffer::ResolveBGR8(unsigned char* dst, const int dstStride, const int width, const int height) const {
+		const int rowWidth = width < m_Width ? width : m_Width;
+		const int rowCount = height < m_Height ? height : m_Height;
+		DispatchColorFormat(m_ColorFormat, [&](auto traits) {
+			using traits_t = decltype(traits);
+			const typename traits_t::pixel_t* pixels = GetColorData<traits_t>();
+			typename traits_t::pixel_t clearPixels[RTL_TILE_SIZE];
+			std::fill(clearPixels, clearPixels + RTL_TILE_SIZE, traits_t::Encode(m_ClearColor));
+			ParallelFor(0, rowCount, [&](const int begin, const int end) {
+				std::vector<Vec3> decoded;
+				for (int i = begin; i < end; i++) {
+					ForEachRowSpan(m_Height - i - 1, 0, rowWidth, [&](const int index, const int tile, const int x, const int count) {
+						// Tiles nobody touched since the last clear resolve straight from the clear value.
+						const bool cleared = m_ColorTileStates[tile].load(std::memory_order_acquire) == TileState::CLEARED;
+						if (!cleared)
+							AcquireColorTile(tile);
+						const typename traits_t::pixel_t* span = cleared ? clearPixels : pixels + index;
+						unsigned char* out = dst + (size_t)i * dstStride + x * 3;
+						if constexpr (std::is_same<typename traits_t::pixel_t, Vec3>::value) {
+							ConvertRowBGR8(out, span, count);
+						}
+						else if constexpr (std::is_same<traits_t, ColorTraits<ColorFormat::RGBA8>>::value) {
+							for (int j = 0; j < count; j++) {
+								out[j * 3 + 0] = (unsigned char)(span[j] >> 16);
+								out[j * 3 + 1] = (unsigned char)(span[j] >> 8);
+								out[j * 3 + 2] = (unsigned char)span[j];
+							}
+						}
+						else {
+							decoded.resize(count);
+							for (int j = 0; j < count; j++)
+								decoded[j] = traits_t::Decode(span[j]);
+							ConvertRowBGR8(out, decoded.data(), count);
+						}
+					});
+				}
+			});
+		});
+	}
+
+	// Glyph rows are top-down from the baseline, framebuffer rows are bottom-up.
+	void Framebuffer::BlitGlyph(const int x, const int baseline, const GlyphCache::Glyph& glyph, const Vec3& color) {
+		if (glyph.Width == 0 || glyph.Height == 0)
+			return;
+
+		const int left = x + glyph.XOff;
+		const int top = baseline + glyph.YOff;
+		const int i0 = std::max<int>(0, -left);
+		const int i1 = std::min<int>(glyph.Width, m_Width - left);
+		const int j0 = std::max<int>(0, 1 - top);
+		const int j1 = std::min<int>(glyph.Height, m_Height - top + 1);
+
+		const GlyphCache& glyphCache = m_Font->GetGlyphCache();
+		const int atlasSize = glyphCache.GetAtlasSize();
+		const unsigned char* atlas = glyphCache.GetPageData(glyph.Page) + glyph.Y * atlasSize + glyph.X;
+
+		DispatchColorFormat(m_ColorFormat, [&](auto traits) {
+			using traits_t = decltype(traits);
+			typename traits_t::pixel_t* pixels = GetColorData<traits_t>();
+			for (int j = j0; j < j1; j++) {
+				const unsigned char* src = atlas + j * atlasSize - left;
+				ForEachRowSpan(m_Height - (top + j), left + i0, left + i1, [&](const int index, const int tile, const int x, const int count) {
+					AcquireColorTile(tile);
+					typename traits_t::pixel_t* dst = pixels + index;
+					for (int i = 0; i < count; i++) {
+						const unsigned char coverage = src[x + i];
+						if (coverage == 0)
+							continue;
+						traits_t::Blend(dst[i], color, coverage * (1.0f / 255.0f));
+					}
+				});
+			}
+		});
 	}
 
 	// short
 	void Framebuffer::LoadFontTTF(const std::string& fontPath) {
-		std::ifstream file(fontPath, std::ios::binary);
-		if (!file) {
-			file.open("C:\\Windows\\Fonts\\" + fontPath + ".ttf", std::ios::binary);
-			if (!file) return;
-		}
-		m_fontBuffer = std::vector<unsigned char>((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
-		file.close();
-        stbtt_InitFont(&m_FontInfo, m_fontBuffer.data(), 0);
+		m_Font = Font::LoadFont(fontPath);
 	}
 
 	void Framebuffer::DrawCharTTF(int x, int y, char c, const Vec3& color, float fontSize) {
-		unsigned char* bitmap;
-		int w, h, xoff, yoff;
-		float scale = stbtt_ScaleForPixelHeight(&m_FontInfo, fontSize);
-
-		bitmap = stbtt_GetCodepointBitmap(&m_FontInfo, 0, scale, c, &w, &h, &xoff, &yoff);
-
-		int ascent, descent, lineGap;;
-		stbtt_GetFontVMetrics(&m_FontInfo, &ascent, &descent, &lineGap);
-		int baseline = int(ascent * scale);
-
-		for (int j = 0; j < h; j++) {
-			for (int i = 0; i < w; i++) {
-				float alpha = bitmap[i + j * w] / 255.0f;
-				if (alpha > 0.1f) {
-					Vec3 col = color * alpha;
-					SetColor(x + i + xoff, m_Height - (y + j + yoff + baseline), col);
-				}
-			}
-		}
-		stbtt_FreeBitmap(bitmap, nullptr);
+		if (!m_Font) return;
+		GlyphCache& glyphCache = m_Font->GetGlyphCache();
+		const int baseline = glyphCache.GetMetrics(fontSize).Baseline;
+		BlitGlyph(x, y + baseline, glyphCache.GetGlyph((unsigned char)c, fontSize), color);
 	}
 
 	void Framebuffer::DrawTextTTF(int x, int y, const std::string& text, const Vec3& color, float fontSize) {
-		float scale = stbtt_ScaleForPixelHeight(&m_FontInfo, fontSize);
-		int xpos = x;
-		
-		for (char c : text) {
-			int ax;
-			int lsb;
-			stbtt_GetCodepointHMetrics(&m_FontInfo, c, &ax, &lsb);
-			DrawCharTTF(xpos, y, c, color, fontSize);
-			int kern = stbtt_GetCodepointKernAdvance(&m_FontInfo, c, c);
-			xpos += int(ax * scale) + kern;
+		if (!m_Font) return;
+		GlyphCache& glyphCache = m_Font->GetGlyphCache();
+		const GlyphCache::FontMetrics& metrics = glyphCache.GetMetrics(fontSize);
+		float xpos = (float)x;
+		int prev = 0;
+
+		for (char ch : text) {
+			const int c = (unsigned char)ch;
+			if (prev)
+				xpos += stbtt_GetCodepointKernAdvance(m_Font->GetInfo(), prev, c) * metrics.Scale;
+			const GlyphCache::Glyph& glyph = glyphCache.GetGlyph(c, fontSize);
+			BlitGlyph((int)xpos, y + metrics.Baseline, glyph, color);
+			xpos += glyph.Advance;
+			prev = c;
 		}
 	}
 
 	// wide
 	void Framebuffer::LoadWFontTTF(const std::wstring& fontPath) {
-		std::wifstream file(fontPath, std::ios::binary);
-		if (!file) {
-			file.open(L"C:\\Windows\\Fonts\\" + fontPath + L".ttf", std::ios::binary);
-			if (!file) return;
-		}
-		m_fontBuffer = std::vector<unsigned char>((std::istreambuf_iterator<wchar_t>(file)), std::istreambuf_iterator<wchar_t>());
-		file.close();
-		stbtt_InitFont(&m_FontInfo, m_fontBuffer.data(), 0);
+		m_Font = Font::LoadWFont(fontPath);
 	}
 
 	void Framebuffer::DrawWCharTTF(int x, int y, wchar_t c, const Vec3& color, float fontSize) {
-		int w, h, xoff, yoff;
-		float scale = stbtt_ScaleForPixelHeight(&m_FontInfo, fontSize);
-
-		unsigned char* bitmap = stbtt_GetCodepointBitmap(
-			&m_FontInfo, 0, scale, c, &w, &h, &xoff, &yoff);
-
-		for (int j = 0; j < h; j++) {
-			for (int i = 0; i < w; i++) {
-				float alpha = bitmap[i + j * w] / 255.0f;
-				if (alpha > 0.1f) {
-					int px = x + i + xoff;
-					int py = m_Height - (y + j + yoff);
-					if (px >= 0 && px < m_Width && py >= 0 && py < m_Height) {
-						Vec3 dst = GetColor(px, py);
-						Vec3 blended = color * alpha + dst * (1.0f - alpha);
-						SetColor(px, py, blended);
-					}
-				}
-			}
-		}
-		stbtt_FreeBitmap(bitmap, nullptr);
+		if (!m_Font) return;
+		BlitGlyph(x, y, m_Font->GetGlyphCache().GetGlyph((int)c, fontSize), color);
 	}
 
 	void Framebuffer::DrawWTextTTF(int x, int y, const std::wstring& text, const Vec3& color, float fontSize) {
-		float scale = stbtt_ScaleForPixelHeight(&m_FontInfo, fontSize);
-		int xpos = x;
-		int ascent, descent, lineGap;;
-		stbtt_GetFontVMetrics(&m_FontInfo, &ascent, &descent, &lineGap);
-		int baseline = int(ascent * scale);
-		for (wchar_t c : text) {
-			int ax;
-			int lsb;
-			stbtt_GetCodepointHMetrics(&m_FontInfo, c, &ax, &lsb);
-			DrawWCharTTF(xpos, y + baseline, c, color, fontSize);
-			int kern = stbtt_GetCodepointKernAdvance(&m_FontInfo, c, c);
-			xpos += int(ax * scale) + kern;
+		if (!m_Font) return;
+		GlyphCache& glyphCache = m_Font->GetGlyphCache();
+		const GlyphCache::FontMetrics& metrics = glyphCache.GetMetrics(fontSize);
+		float xpos = (float)x;
+		int prev = 0;
+
+		for (wchar_t wc : text) {
+			const int c = (int)wc;
+			if (prev)
+				xpos += stbtt_GetCodepointKernAdvance(m_Font->GetInfo(), prev, c) * metrics.Scale;
+			const GlyphCache::Glyph& glyph = glyphCache.GetGlyph(c, fontSize);
+			BlitGlyph((int)xpos, y + metrics.Baseline, glyph, color);
+			xpos += glyph.Advance;
+			prev = c;
 		}
 	}
 
-	Framebuffer* Framebuffer::Create(const int width, const int height) {
-		return new Framebuffer(width, height);
+	Framebuffer* Framebuffer::Create(const int width, const int height, const ColorFormat colorFormat,
+									 const FramebufferLayout layout, const DepthFormat depthFormat) {
+		return new Framebuffer(width, height, colorFormat, layout, depthFormat);
 	}
 
 }
@@ -1,28 +1,105 @@
 #pragma once
 
 #include "RTL/Base/Maths.h"
+#include "RTL/Window/ColorFormat.h"
+#include "RTL/Window/DepthFormat.h"
+#include "RTL/Window/GlyphCache.h"
 
 #include <Windows.h>
 #include <stb_image/stb_truetype.h>
 #include <fstream>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+
+#define RTL_TILE_SHIFT 3
+#define RTL_TILE_SIZE (1 << RTL_TILE_SHIFT)
+#define RTL_TILE_MASK (RTL_TILE_SIZE - 1)
 
 namespace RTL {
 
+	// TILED stores color and depth as contiguous RTL_TILE_SIZE x RTL_TILE_SIZE blocks, detiled on present.
+	enum class FramebufferLayout {
+		LINEAR,
+		TILED
+	};
+
 	class Framebuffer {
 	public:
-		Framebuffer(const int width, const int height);
+		Framebuffer(const int width, const int height,
+					const ColorFormat colorFormat = ColorFormat::RGB32F,
+					const FramebufferLayout layout = FramebufferLayout::LINEAR,
+					const DepthFormat depthFormat = DepthFormat::FLOAT32);
 		~Framebuffer();
 
 		int GetWidth() const { return m_Width; }
 		int GetHeight() const { return m_Height; }
+		ColorFormat GetColorFormat() const { return m_ColorFormat; }
+		DepthFormat GetDepthFormat() const { return m_DepthFormat; }
+		FramebufferLayout GetLayout() const { return m_Layout; }
+		int GetTileCountX() const { return m_TileCountX; }
+		int GetTileCountY() const { return m_TileCountY; }
+
+		int GetPixelIndex(const int x, const int y) const {
+			if (m_Layout == FramebufferLayout::LINEAR)
+				return y * m_Width + x;
+			const int tile = (y >> RTL_TILE_SHIFT) * m_TileCountX + (x >> RTL_TILE_SHIFT);
+			return (tile << (2 * RTL_TILE_SHIFT)) + ((y & RTL_TILE_MASK) << RTL_TILE_SHIFT) + (x & RTL_TILE_MASK);
+		}
+
+		int GetTileIndex(const int x, const int y) const {
+			return (y >> RTL_TILE_SHIFT) * m_TileCountX + (x >> RTL_TILE_SHIFT);
+		}
+
+		// Materializes a fast-cleared tile; call before touching that tile through GetColorData/GetDepthData.
+		// GetRenderTarget buffers are never fast-cleared and need no acquire.
+		void AcquireColorTile(const int tile) const {
+			if (m_ColorTileStates[tile].load(std::memory_order_acquire) != TileState::VALID)
+				MaterializeColorTile(tile);
+		}
+		void AcquireDepthTile(const int tile) const {
+			if (m_DepthTileStates[tile].load(std::memory_order_acquire) != TileState::VALID)
+				MaterializeDepthTile(tile);
+		}
+		bool IsDepthTileCleared(const int tile) const {
+			return m_DepthTileStates[tile].load(std::memory_order_acquire) == TileState::CLEARED;
+		}
+
+		// Unchecked accessors addressed by GetPixelIndex, for the rasterizer inner loops.
+		template<typename traits_t>
+		typename traits_t::depth_t* GetDepthData() const {
+			return (typename traits_t::depth_t*)m_DepthBuffer;
+		}
+		template<typename traits_t>
+		typename traits_t::pixel_t* GetColorData() const {
+			return (typename traits_t::pixel_t*)m_ColorBuffer;
+		}
 
 		void SetColor(const int x, const int y, const Vec3& color);
 		Vec3 GetColor(const int x, const int y) const;
+		void BlendColor(const int x, const int y, const Vec3& color, const float alpha);
+		void ReadColorRow(const int y, Vec3* dst) const;
 		void SetDepth(const int x, const int y, const float depth);
 		float GetDepth(const int x, const int y) const;
 
+		// Fast clears: only the per-tile flags are reset, pixels are written when a tile is first touched.
 		void Clear(const Vec3& color = Vec3(0.0f, 0.0f, 0.0f));
 		void ClearDepth(const float depth = 1.0f);
+		Vec3 GetClearColor() const { return m_ClearColor; }
+		float GetClearDepth() const { return m_ClearDepth; }
+
+		// Extra per-pixel targets such as a G-buffer, addressed with GetPixelIndex like color and depth.
+		// They are not cleared; readers must check depth coverage first.
+		int AddRenderTarget(const int elementSize);
+		int GetRenderTargetCount() const { return (int)m_RenderTargets.size(); }
+		template<typename T>
+		T* GetRenderTarget(const int target) const {
+			return (T*)m_RenderTargets[target].data();
+		}
+
+		// Framebuffers that present in turn should share one font, see Font.
+		void SetFont(const std::shared_ptr<Font>& font) { m_Font = font; }
+		const std::shared_ptr<Font>& GetFont() const { return m_Font; }
 
 		// short
 		void LoadFontTTF(const std::string& fontPath);
@@ -34,22 +111,75 @@ namespace RTL {
 		void DrawWCharTTF(int x, int y, wchar_t c, const Vec3& color, float fontSize);
 		void DrawWTextTTF(int x, int y, const std::wstring& text, const Vec3& color, float fontSize);
 
-		const float* GetRawColorData() const { return (float*)(m_ColorBuffer); }
+		const void* GetRawColorData() const { return m_ColorBuffer; }
 
-		static Framebuffer* Create(const int width, const int height);
+		// Writes the color buffer as bottom-up flipped 8-bit BGR rows into any backend pixel buffer.
+		void ResolveBGR8(unsigned char* dst, const int dstStride, const int width, const int height) const;
+
+		static Framebuffer* Create(const int width, const int height,
+								   const ColorFormat colorFormat = ColorFormat::RGB32F,
+								   const FramebufferLayout layout = FramebufferLayout::LINEAR,
+								   const DepthFormat depthFormat = DepthFormat::FLOAT32);
 
 	private:
-		int GetPixelIndex(const int x, const int y) const { return (y * m_Width + x) * 3; }
+		enum class TileState : uint8_t {
+			VALID,
+			CLEARED,
+			BUSY
+		};
+
+		void MaterializeColorTile(const int tile) const;
+		void MaterializeDepthTile(const int tile) const;
+		static bool BeginMaterialize(std::atomic<TileState>& state);
+
+		// Calls func(index, tile, x, count) for each run of pixels of row y in [x0, x1) within one tile.
+		template<typename func_t>
+		void ForEachRowSpan(const int y, const int x0, const int x1, const func_t& func) const {
+			for (int x = x0; x < x1;) {
+				const int end = std::min<int>((x | RTL_TILE_MASK) + 1, x1);
+				func(GetPixelIndex(x, y), GetTileIndex(x, y), x, end - x);
+				x = end;
+			}
+		}
+
+		// Calls func(index, count) for each contiguous run of pixels covered by a tile.
+		template<typename func_t>
+		void ForEachTileSpan(const int tile, const func_t& func) const {
+			if (m_Layout == FramebufferLayout::TILED) {
+				func(tile << (2 * RTL_TILE_SHIFT), RTL_TILE_SIZE * RTL_TILE_SIZE);
+				return;
+			}
+			const int x0 = (tile % m_TileCountX) << RTL_TILE_SHIFT;
+			const int y0 = (tile / m_TileCountX) << RTL_TILE_SHIFT;
+			const int count = std::min<int>(RTL_TILE_SIZE, m_Width - x0);
+			const int y1 = std::min<int>(y0 + RTL_TILE_SIZE, m_Height);
+			for (int y = y0; y < y1; y++)
+				func(GetPixelIndex(x0, y), count);
+		}
+
+		void BlitGlyph(const int x, const int baseline, const GlyphCache::Glyph& glyph, const Vec3& color);
 
 	private:
 		int m_Width;
 		int m_Height;
 		int m_PixelSize;
-		float* m_DepthBuffer;
-		Vec3* m_ColorBuffer;
+		DepthFormat m_DepthFormat;
+		unsigned char* m_DepthBuffer;
+
+		FramebufferLayout m_Layout;
+		int m_TileCountX, m_TileCountY;
+
+		Vec3 m_ClearColor;
+		float m_ClearDepth;
+		std::atomic<TileState>* m_ColorTileStates;
+		std::atomic<TileState>* m_DepthTileStates;
+
+		ColorFormat m_ColorFormat;
+		unsigned char* m_ColorBuffer;
+
+		std::vector<std::vector<unsigned char>> m_RenderTargets;
 
-		stbtt_fontinfo m_FontInfo;
-		std::vector<unsigned char> m_fontBuffer;
+		std::shared_ptr<Font> m_Font;
 	};
 
 }
@@ -0,0 +1,137 @@
+#include "GlyphCache.h"
+
+#include "RTL/Base/Base.h"
+
+#include <fstream>
+#include <iterator>
+
+namespace RTL {
+
+	GlyphCache::GlyphCache(const stbtt_fontinfo* fontInfo, const int atlasSize)
+		: m_FontInfo(fontInfo), m_AtlasSize(atlasSize) {
+		ASSERT(fontInfo && atlasSize > 0);
+	}
+
+	const GlyphCache::FontMetrics& GlyphCache::GetMetrics(const float fontSize) {
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		return FindMetrics(fontSize);
+	}
+
+	const GlyphCache::FontMetrics& GlyphCache::FindMetrics(const float fontSize) {
+		const uint32_t key = GetSizeKey(fontSize);
+		auto it = m_Metrics.find(key);
+		if (it != m_Metrics.end())
+			return it->second;
+
+		FontMetrics metrics;
+		metrics.Scale = stbtt_ScaleForPixelHeight(m_FontInfo, fontSize);
+		int ascent, descent, lineGap;
+		stbtt_GetFontVMetrics(m_FontInfo, &ascent, &descent, &lineGap);
+		metrics.Baseline = int(ascent * metrics.Scale);
+		return m_Metrics.emplace(key, metrics).first->second;
+	}
+
+	const GlyphCache::Glyph& GlyphCache::GetGlyph(const int codepoint, const float fontSize) {
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		const uint64_t key = ((uint64_t)GetSizeKey(fontSize) << 32) | (uint32_t)codepoint;
+		auto it = m_Glyphs.find(key);
+		if (it != m_Glyphs.end())
+			return it->second;
+
+		const float scale = FindMetrics(fontSize).Scale;
+
+		Glyph glyph;
+		int ax, lsb;
+		stbtt_GetCodepointHMetrics(m_FontInfo, codepoint, &ax, &lsb);
+		glyph.Advance = ax * scale;
+
+		int x0, y0, x1, y1;
+		stbtt_GetCodepointBitmapBox(m_FontInfo, codepoint, scale, scale, &x0, &y0, &x1, &y1);
+		glyph.XOff = x0;
+		glyph.YOff = y0;
+
+		if (x1 > x0 && y1 > y0 && Pack(x1 - x0, y1 - y0, glyph)) {
+			Page& page = *m_Pages[glyph.Page];
+			unsigned char* dst = page.Pixels.data() + glyph.Y * m_AtlasSize + glyph.X;
+			stbtt_MakeCodepointBitmap(m_FontInfo, dst, glyph.Width, glyph.Height, m_AtlasSize, scale, scale, codepoint);
+		}
+
+		return m_Glyphs.emplace(key, glyph).first->second;
+	}
+
+	// Pages are never freed or resized, so the pointer stays valid after the lock is released.
+	const unsigned char* GlyphCache::GetPageData(const int page) const {
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		return m_Pages[page]->Pixels.data();
+	}
+
+	int GlyphCache::GetPageCount() const {
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		return (int)m_Pages.size();
+	}
+
+	bool GlyphCache::Pack(const int width, const int height, Glyph& glyph) {
+		if (width > m_AtlasSize || height > m_AtlasSize)
+			return false;
+
+		stbrp_rect rect = {};
+		rect.w = width;
+		rect.h = height;
+
+		int pageIndex = -1;
+		for (size_t i = 0; i < m_Pages.size() && pageIndex < 0; i++) {
+			if (stbrp_pack_rects(&m_Pages[i]->Context, &rect, 1))
+				pageIndex = (int)i;
+		}
+		if (pageIndex < 0) {
+			AddPage();
+			if (!stbrp_pack_rects(&m_Pages.back()->Context, &rect, 1))
+				return false;
+			pageIndex = (int)m_Pages.size() - 1;
+		}
+
+		glyph.Page = pageIndex;
+		glyph.X = rect.x;
+		glyph.Y = rect.y;
+		glyph.Width = width;
+		glyph.Height = height;
+		return true;
+	}
+
+	void GlyphCache::AddPage() {
+		std::unique_ptr<Page> page(new Page());
+		page->Nodes.resize(m_AtlasSize);
+		page->Pixels.assign((size_t)m_AtlasSize * m_AtlasSize, 0);
+		stbrp_init_target(&page->Context, m_AtlasSize, m_AtlasSize, page->Nodes.data(), (int)page->Nodes.size());
+		m_Pages.push_back(std::move(page));
+	}
+
+	Font::Font(std::vector<unsigned char>&& buffer)
+		: m_Buffer(std::move(buffer)) {
+		stbtt_InitFont(&m_Info, m_Buffer.data(), 0);
+		m_GlyphCache.reset(new GlyphCache(&m_Info));
+	}
+
+	// short
+	std::shared_ptr<Font> Font::LoadFont(const std::string& fontPath) {
+		std::ifstream file(fontPath, std::ios::binary);
+		if (!file) {
+			file.open("C:\\Windows\\Fonts\\" + fontPath + ".ttf", std::ios::binary);
+			if (!file) return nullptr;
+		}
+		std::vector<unsigned char> buffer((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		return std::shared_ptr<Font>(new Font(std::move(buffer)));
+	}
+
+	// wide
+	std::shared_ptr<Font> Font::LoadWFont(const std::wstring& fontPath) {
+		std::wifstream file(fontPath, std::ios::binary);
+		if (!file) {
+			file.open(L"C:\\Windows\\Fonts\\" + fontPath + L".ttf", std::ios::binary);
+			if (!file) return nullptr;
+		}
+		std::vector<unsigned char> buffer((std::istreambuf_iterator<wchar_t>(file)), std::istreambuf_iterator<wchar_t>());
+		return std::shared_ptr<Font>(new Font(std::move(buffer)));
+	}
+
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stb_image/stb_rect_pack.h>
+#include <stb_image/stb_truetype.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+
+#define RTL_GLYPH_ATLAS_SIZE 512
+
+namespace RTL {
+
+	// Shared by every framebuffer of a pipelined present, lookups lock because a miss rasterizes into the atlas.
+	class GlyphCache {
+	public:
+		struct Glyph {
+			int Page = 0;
+			int X = 0, Y = 0;
+			int Width = 0, Height = 0;
+			int XOff = 0, YOff = 0;
+			float Advance = 0.0f;
+		};
+
+		struct FontMetrics {
+			float Scale;
+			int Baseline;
+		};
+
+		GlyphCache(const stbtt_fontinfo* fontInfo, const int atlasSize = RTL_GLYPH_ATLAS_SIZE);
+
+		const Glyph& GetGlyph(const int codepoint, const float fontSize);
+		const FontMetrics& GetMetrics(const float fontSize);
+
+		const unsigned char* GetPageData(const int page) const;
+		int GetPageCount() const;
+		int GetAtlasSize() const { return m_AtlasSize; }
+
+	private:
+		struct Page {
+			stbrp_context Context;
+			std::vector<stbrp_node> Nodes;
+			std::vector<unsigned char> Pixels;
+		};
+
+		static uint32_t GetSizeKey(const float fontSize) { return (uint32_t)(fontSize * 64.0f + 0.5f); }
+
+		const FontMetrics& FindMetrics(const float fontSize);
+		bool Pack(const int width, const int height, Glyph& glyph);
+		void AddPage();
+
+	private:
+		const stbtt_fontinfo* m_FontInfo;
+		int m_AtlasSize;
+
+		mutable std::mutex m_Mutex;
+		std::vector<std::unique_ptr<Page>> m_Pages;
+		std::unordered_map<uint64_t, Glyph> m_Glyphs;
+		std::unordered_map<uint32_t, FontMetrics> m_Metrics;
+	};
+
+	// A loaded TrueType file and its glyph cache, loaded once and shared by all framebuffers.
+	class Font {
+	public:
+		static std::shared_ptr<Font> LoadFont(const std::string& fontPath);
+		static std::shared_ptr<Font> LoadWFont(const std::wstring& fontPath);
+
+		const stbtt_fontinfo* GetInfo() const { return &m_Info; }
+		GlyphCache& GetGlyphCache() { return *m_GlyphCache; }
+
+		Font(const Font&) = delete;
+		Font& operator=(const Font&) = delete;
+
+	private:
+		Font(std::vector<unsigned char>&& buffer);
+
+	private:
+		std::vector<unsigned char> m_Buffer;
+		stbtt_fontinfo m_Info;
+		std::unique_ptr<GlyphCache> m_GlyphCache;
+	};
+
+}
@@ -19,6 +19,7 @@ namespace RTL {
 		static Window* Create(const std::string title, int width, int height);
 
 		void Show();
+		void Present();
 		void DrawFramebuffer(Framebuffer* framebuffer);
 
 		bool Closed() const { return m_Closed; }
@@ -0,0 +1,3 @@
+#include <string.h>
+#define STB_DXT_IMPLEMENTATION
+#include <stb_image/stb_dxt.h>
@@ -1,2 +1,3 @@
+#include "stb_image/stb_rect_pack.h"
 #define STB_TRUETYPE_IMPLEMENTATION
 #include "stb_image/stb_truetype.h"